@@ -0,0 +1,138 @@
+/*
+ * BitSlicedDecoder.h
+ */
+#ifndef BITSLICEDDECODER_H_
+#define BITSLICEDDECODER_H_
+
+#include "NewEncoder.h"
+
+namespace BitSlicedDetail {
+// Halves of a truth table over 'vars' inputs, split on the top input
+constexpr uint16_t lowHalf(uint16_t tt, uint8_t vars) {
+	return tt & ((1u << (1u << (vars - 1))) - 1);
+}
+
+constexpr uint16_t highHalf(uint16_t tt, uint8_t vars) {
+	return tt >> (1u << (vars - 1));
+}
+} // namespace BitSlicedDetail
+
+// Advances the state machines of up to 8 / 16 / 32 encoders (one per bit of Word) in parallel.
+// The 3-bit state of every encoder is kept as three bit-planes; bit n of each plane belongs to encoder n.
+// The next-state and delta logic is generated at compile time from NewEncoder's transition tables: each
+// output bit is a 16-entry truth table (state, pin level) that is expanded into a multiplexer tree of
+// bitwise operations. The compiler folds the constant leaves, leaving a short branch-free sequence.
+//
+// step() takes the A and B pin levels of all encoders (e.g. gathered from one port snapshot) and returns
+// the masks of encoders that counted up / down. If both pins of an encoder changed since the last sample, the A
+// change is applied before the B change. NewEncoder / NewEncoderPort instead apply the pair in the order that
+// continues the recent rotation (see NewEncoder::applyPinLevels()), so on missed edges the two can differ.
+// This kernel is standalone: no NewEncoder backend runs through it.
+template<typename Word, uint8_t TYPE = FULL_PULSE>
+class BitSlicedDecoder {
+	static_assert((TYPE == FULL_PULSE) || (TYPE == HALF_PULSE), "TYPE must be FULL_PULSE or HALF_PULSE");
+public:
+	static constexpr uint8_t lanes = 8 * sizeof(Word);
+
+	// Set every lane's state from the resting pin levels, same as NewEncoder::begin()
+	void reset(Word aLevels, Word bLevels) {
+		s0 = aLevels;
+		s1 = bLevels;
+		s2 = (TYPE == HALF_PULSE) ? (aLevels & bLevels) : 0;  // HALF_PULSE rests in DETENT_1 (0b111) with both pins high
+		lastA = aLevels;
+		lastB = bLevels;
+	}
+
+	void step(Word aLevels, Word bLevels, Word &incrementMask, Word &decrementMask) {
+		incrementMask = 0;
+		decrementMask = 0;
+		Word changed = aLevels ^ lastA;
+		if (changed != 0) {
+			advance<0>(aLevels, changed, incrementMask, decrementMask);
+			lastA = aLevels;
+		}
+		changed = bLevels ^ lastB;
+		if (changed != 0) {
+			advance<1>(bLevels, changed, incrementMask, decrementMask);
+			lastB = bLevels;
+		}
+	}
+
+	uint8_t state(uint8_t lane) const {
+		return (((s2 >> lane) & 1) << 2) | (((s1 >> lane) & 1) << 1) | ((s0 >> lane) & 1);
+	}
+
+	void setState(uint8_t lane, uint8_t newState) {
+		const Word bit = static_cast<Word>(1) << lane;
+		s0 = (newState & 0b001) ? (s0 | bit) : (s0 & ~bit);
+		s1 = (newState & 0b010) ? (s1 | bit) : (s1 & ~bit);
+		s2 = (newState & 0b100) ? (s2 | bit) : (s2 & ~bit);
+	}
+
+	// Collect one bit per lane from a port snapshot. masks[n] selects the bit for lane n.
+	template<typename RegType>
+	static Word gather(RegType snapshot, const RegType *masks, uint8_t numLanes) {
+		Word result = 0;
+		for (uint8_t lane = 0; lane < numLanes; lane++) {
+			if ((snapshot & masks[lane]) != 0) {
+				result |= static_cast<Word>(1) << lane;
+			}
+		}
+		return result;
+	}
+
+private:
+	static constexpr uint8_t tableEntry(uint8_t state, uint8_t index) {
+		return (TYPE == HALF_PULSE) ?
+				NewEncoder::halfPulseTransitionTable[state][index] : NewEncoder::fullPulseTransitionTable[state][index];
+	}
+
+	// Bit 'bit' of the table entry for every (state, level) combination of one pin. Minterm m = (state << 1) | level.
+	static constexpr uint16_t truthTable(uint8_t pin, uint8_t bit, uint8_t m = 0) {
+		return (m == 16) ? 0 :
+				static_cast<uint16_t>((((tableEntry(m >> 1, (pin << 1) | (m & 1)) >> bit) & 1) << m) | truthTable(pin, bit, m + 1));
+	}
+
+	// Evaluate a VARS-input truth table on bit-planes x[0] .. x[VARS - 1] by splitting on the top variable
+	template<uint16_t TT, uint8_t VARS, bool SAME_HALVES = (VARS != 0) &&
+			(BitSlicedDetail::lowHalf(TT, VARS) == BitSlicedDetail::highHalf(TT, VARS))>
+	struct Slice {
+		static Word eval(const Word *x) {
+			return (Slice<BitSlicedDetail::lowHalf(TT, VARS), VARS - 1>::eval(x) & ~x[VARS - 1])
+					| (Slice<BitSlicedDetail::highHalf(TT, VARS), VARS - 1>::eval(x) & x[VARS - 1]);
+		}
+	};
+
+	// Top variable doesn't matter
+	template<uint16_t TT, uint8_t VARS>
+	struct Slice<TT, VARS, true> {
+		static Word eval(const Word *x) {
+			return Slice<BitSlicedDetail::lowHalf(TT, VARS), VARS - 1>::eval(x);
+		}
+	};
+
+	template<uint16_t TT>
+	struct Slice<TT, 0, false> {
+		static Word eval(const Word *) {
+			return (TT & 1) ? static_cast<Word>(~static_cast<Word>(0)) : 0;
+		}
+	};
+
+	template<uint8_t PIN>
+	void advance(Word levels, Word changed, Word &incrementMask, Word &decrementMask) {
+		const Word x[4] = { levels, s0, s1, s2 };
+		const Word n0 = Slice<truthTable(PIN, 0), 4>::eval(x);
+		const Word n1 = Slice<truthTable(PIN, 1), 4>::eval(x);
+		const Word n2 = Slice<truthTable(PIN, 2), 4>::eval(x);
+		incrementMask |= Slice<truthTable(PIN, 3), 4>::eval(x) & changed;
+		decrementMask |= Slice<truthTable(PIN, 4), 4>::eval(x) & changed;
+		s0 = (n0 & changed) | (s0 & ~changed);
+		s1 = (n1 & changed) | (s1 & ~changed);
+		s2 = (n2 & changed) | (s2 & ~changed);
+	}
+
+	Word s0 = 0, s1 = 0, s2 = 0;
+	Word lastA = 0, lastB = 0;
+};
+
+#endif /* BITSLICEDDECODER_H_ */
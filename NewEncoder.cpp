@@ -4,70 +4,176 @@
 
 #include "NewEncoder.h"
 
-#define A_PIN_FALLING 0b00
-#define A_PIN_RISING 0b01
-#define B_PIN_FALLING 0b10
-#define B_PIN_FALLING 0b10
-#define B_PIN_RISING  0b11
-
-// Define states and transition table for "one pulse per detent" type encoder
-#define START_STATE 0b011
-#define CW_STATE_1 0b010
-#define CW_STATE_2 0b000
-#define CW_STATE_3 0b001
-#define CCW_STATE_1 0b101
-#define CCW_STATE_2 0b100
-#define CCW_STATE_3 0b110
-
-const NewEncoder::encoderStateTransition NewEncoder::fullPulseTransitionTable[] = {
-		{ CW_STATE_2, CW_STATE_3, CW_STATE_2, CW_STATE_1 }, // cwState2 = 0b000
-		{ CW_STATE_2, CW_STATE_3, CW_STATE_3, START_STATE | INCREMENT_DELTA }, // cwState3 = 0b001
-		{ CW_STATE_1, START_STATE, CW_STATE_2, CW_STATE_1 },  // cwState1 = 0b010
-		{ CW_STATE_1, START_STATE, CCW_STATE_1, START_STATE }, // startState = 0b011
-		{ CCW_STATE_2, CCW_STATE_1, CCW_STATE_2, CCW_STATE_3 }, // ccwState2 = 0b100
-		{ CCW_STATE_2, CCW_STATE_1, CCW_STATE_1, START_STATE }, // ccwState1 = 0b101
-		{ CCW_STATE_3, START_STATE | DECREMENT_DELTA, CCW_STATE_2, CCW_STATE_3 }, // ccwState3 = 0b110
-		{ START_STATE, START_STATE, START_STATE, START_STATE } // 0b111 illegal state should never be in it
-};
+constexpr NewEncoder::encoderStateTransition NewEncoder::fullPulseTransitionTable[] NEWENCODER_TABLE_ATTR;
+constexpr NewEncoder::encoderStateTransition NewEncoder::halfPulseTransitionTable[] NEWENCODER_TABLE_ATTR;
+constexpr NewEncoder::encoderStateTransition NewEncoder::quadX4TransitionTable[] NEWENCODER_TABLE_ATTR;
+constexpr NewEncoder::encoderStateTransition NewEncoder::quadX2TransitionTable[] NEWENCODER_TABLE_ATTR;
 
-// Define states and transition table for "one pulse per two detents" type encoder
-#define DETENT_0 0b000
-#define DETENT_1 0b111
-#define DEBOUNCE_0 0b010
-#define DEBOUNCE_1 0b001
-#define DEBOUNCE_2 0b101
-#define DEBOUNCE_3 0b110
-
-const NewEncoder::encoderStateTransition NewEncoder::halfPulseTransitionTable[] = {
-		{ DETENT_0, DEBOUNCE_1, DETENT_0, DEBOUNCE_0 },  // DETENT_0 0b000
-		{ DETENT_0, DEBOUNCE_1, DEBOUNCE_1, DETENT_1 | INCREMENT_DELTA }, // DEBOUNCE_1 0b001
-		{ DEBOUNCE_0, DETENT_1 | DECREMENT_DELTA, DETENT_0, DEBOUNCE_0 },  // DEBOUNCE_0 0b010
-		{ DETENT_1, DETENT_1, DETENT_1, DETENT_1 },  // 0b011 - illegal state should never be in it
-		{ DETENT_0, DETENT_0, DETENT_0, DETENT_0 },  // 0b100 - illegal state should never be in it
-		{ DETENT_0 | DECREMENT_DELTA, DEBOUNCE_2, DEBOUNCE_2, DETENT_1 }, // DEBOUNCE_2 0b101
-		{ DEBOUNCE_3, DETENT_1, DETENT_0 | INCREMENT_DELTA, DEBOUNCE_3 },  // DEBOUNCE_3 0b110
-		{ DEBOUNCE_3, DETENT_1, DEBOUNCE_2, DETENT_1 }  // DETENT_1 0b111
+#if NEWENCODER_ACCELERATION
+// Ordered fastest (shortest interval) first. Intervals are in microseconds.
+const NewEncoder::AccelerationStep NewEncoder::defaultAccelerationCurve[] = {
+		{ 5000, 50 },
+		{ 10000, 20 },
+		{ 20000, 10 },
+		{ 40000, 5 },
+		{ 80000, 2 }
 };
+const uint8_t NewEncoder::defaultAccelerationCurveSteps = sizeof(defaultAccelerationCurve) / sizeof(defaultAccelerationCurve[0]);
+#endif
 
 #ifndef USE_FUNCTIONAL_ISR
+#if NEWENCODER_SHARED_INTERRUPTS
+NewEncoder::isrLink *NewEncoder::_isrChain[CORE_NUM_INTERRUPT];
+
+// Runs every pin change function linked to interrupt INTERRUPT_NUMBER. Each one returns right away if its pin didn't change.
+template<uint8_t INTERRUPT_NUMBER>
+void NewEncoder::isrTrampoline() {
+	for (isrLink *link = _isrChain[INTERRUPT_NUMBER]; link != nullptr; link = link->next) {
+		(link->objectPtr->*link->functPtr)();
+	}
+}
+#else
 NewEncoder::isrInfo NewEncoder::_isrTable[CORE_NUM_INTERRUPT];
+
+template<uint8_t INTERRUPT_NUMBER>
+void NewEncoder::isrTrampoline() {
+	NewEncoder *objectPtr = _isrTable[INTERRUPT_NUMBER].objectPtr;
+	if (objectPtr != nullptr) {
+		(objectPtr->*_isrTable[INTERRUPT_NUMBER].functPtr)();
+	}
+}
+#endif
+
+template<uint8_t ... INTERRUPT_NUMBERS>
+struct NewEncoder::TrampolineTable<NewEncoder::IndexSequence<INTERRUPT_NUMBERS...>> {
+	static constexpr isrFunct entries[sizeof...(INTERRUPT_NUMBERS)] = { &NewEncoder::isrTrampoline<INTERRUPT_NUMBERS>... };
+};
+
+template<uint8_t ... INTERRUPT_NUMBERS>
+constexpr NewEncoder::isrFunct NewEncoder::TrampolineTable<NewEncoder::IndexSequence<INTERRUPT_NUMBERS...>>::entries[];
+#endif
+
+uint8_t NewEncoder::_claimedInterrupts[(CORE_NUM_INTERRUPT + 7) / 8];
+
+#if NEWENCODER_POLLING
+NewEncoder *NewEncoder::polledEncoders = nullptr;
+#endif
+#if NEWENCODER_STORM_PROTECTION
+NewEncoder *NewEncoder::stormEncoders = nullptr;
+#endif
+#if NEWENCODER_DEFERRED
+NewEncoder *NewEncoder::deferredEncoders[NEWENCODER_MAX_DEFERRED];
+volatile uint32_t NewEncoder::deferredPending = 0;
+#if defined(ESP32)
+volatile TaskHandle_t NewEncoder::serviceTaskHandle = nullptr;
+#endif
+#endif
+
+#if NEWENCODER_ATOMIC_STATE
+using namespace NewEncoderAtomic;
+#endif
+
+#if NEWENCODER_STATS
+#if NEWENCODER_ATOMIC_STATE
+#define STATS_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define STATS_FENCE() __asm__ __volatile__("" ::: "memory")  // ISR and reader share one core
+#endif
+
+// Every ISR entry point is a seqlock write section, so getStats() can take a consistent copy without blocking the ISR
+#define STATS_ISR_BEGIN() STATS_TIMER_START(isrStart); statsSequence++; STATS_FENCE()
+#define STATS_ISR_END() STATS_RECORD(isrHistogram, isrStart); STATS_FENCE(); statsSequence++
+#define STATS_INCREMENT(counter) liveStats.counter++
+#define STATS_TIMER_START(name) uint32_t name = NEWENCODER_STATS_TIMER()
+#define STATS_RECORD(histogram, start) recordDuration(liveStats.histogram, NEWENCODER_STATS_TIMER() - (start))
+
+// Bucket 0 counts durations of 0 ticks, bucket n counts 2^(n-1) to 2^n - 1 ticks. The last bucket also counts anything longer.
+static inline void recordDuration(volatile uint32_t *histogram, uint32_t duration) {
+	uint8_t bucket = 0;
+	if (duration != 0) {
+		bucket = (8 * sizeof(unsigned long)) - __builtin_clzl(duration);
+		if (bucket >= NEWENCODER_STATS_BUCKETS) {
+			bucket = NEWENCODER_STATS_BUCKETS - 1;
+		}
+	}
+	histogram[bucket]++;
+}
+#else
+#define STATS_ISR_BEGIN()
+#define STATS_ISR_END()
+#define STATS_INCREMENT(counter)
+#define STATS_TIMER_START(name)
+#define STATS_RECORD(histogram, start)
+#endif
+
+#if NEWENCODER_TRACE
+#define TRACE_PUSH(pinMask, levels) if (traceRing != nullptr) { traceRing->push(pinMask, levels); }
+#else
+#define TRACE_PUSH(pinMask, levels)
+#endif
+
+#if NEWENCODER_TRANSITION_COUNTS
+#define COUNT_TRANSITION(counter) counter++
+#else
+#define COUNT_TRANSITION(counter)
+#endif
+
+// Start of every pin interrupt handler: ignore the interrupt if storm protection rejects it
+#if NEWENCODER_STORM_PROTECTION
+#define RETURN_IF_STORM() if ((stormMaxEdges != 0) && stormRejects()) { return; }
+#else
+#define RETURN_IF_STORM()
 #endif
 
-NewEncoder::NewEncoder(uint8_t aPin, uint8_t bPin, int16_t minValue,
-		int16_t maxValue, int16_t initalValue, uint8_t type) {
+NewEncoder::NewEncoder(uint8_t aPin, uint8_t bPin, EncoderValue minValue,
+		EncoderValue maxValue, EncoderValue initalValue, uint8_t type) {
+#if NEWENCODER_COMPACT
+	initPackedState();
+#endif
 	active = false;
 	configure(aPin, bPin, minValue, maxValue, initalValue, type);
 }
 
+NewEncoder::NewEncoder(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue,
+		EncoderValue initalValue, const encoderStateTransition (&table)[8]) {
+#if NEWENCODER_COMPACT
+	initPackedState();
+#endif
+	active = false;
+	configure(aPin, bPin, minValue, maxValue, initalValue, table);
+}
+
 NewEncoder::NewEncoder() {
+#if NEWENCODER_COMPACT
+	initPackedState();
+#endif
 	active = false;
 	configured = false;
 	_aPin_register = nullptr;
 	_bPin_register = nullptr;
 }
 
+#if NEWENCODER_COMPACT
+// Bit-fields can't have default member initializers before C++20
+void NewEncoder::initPackedState() {
+	active = false;
+	portDriven = false;
+#if NEWENCODER_POLLING
+	pollDriven = false;
+#endif
+	bothPinSampling = false;
+#if NEWENCODER_CLICK_FLAGS
+	clickUp = false;
+	clickDown = false;
+#endif
+}
+#endif
+
 NewEncoder::~NewEncoder() {
 	end();
+#if NEWENCODER_DEFERRED
+	releaseDeferredSlot();
+#endif
 }
 
 void NewEncoder::end() {
@@ -75,15 +181,182 @@ void NewEncoder::end() {
 		return;
 	}
 	active = false;
+	if (portDriven) {
+		portDriven = false;
+		return;
+	}
+#if NEWENCODER_POLLING
+	if (pollDriven) {
+		noInterrupts();
+		unlinkFrom(polledEncoders);
+		nextPolled = nullptr;
+		pollDriven = false;
+		interrupts();
+		return;
+	}
+#endif
+
+#if NEWENCODER_STORM_PROTECTION
+	// A storm may have detached the interrupts already and handed the encoder to serviceStorms()
+	noInterrupts();
+	uint8_t storm = stormState;
+	if (storm != STORM_NONE) {
+		unlinkFrom(stormEncoders);
+		nextPolled = nullptr;
+		stormMillis += millis() - stormStartMillis;
+	}
+#ifndef USE_FUNCTIONAL_ISR
+	if (storm != STORM_POLLING) {
+		detachPinInterrupts();
+	}
+	stormState = STORM_NONE;
+	interrupts();
+#else
+	stormState = STORM_DETACH_PENDING;  // Storm protection ignores interrupts until they are detached
+	interrupts();
+	if (storm != STORM_POLLING) {
+		detachPinInterrupts();
+	}
+	stormState = STORM_NONE;
+#endif
+	// Like leaveStorm(). The interrupts are detached, so a begin() within the same window starts counting afresh.
+	stormEdges = 0;
+	stormWindowStart = micros();
+#else
+#ifndef USE_FUNCTIONAL_ISR
+	noInterrupts();
+	detachPinInterrupts();
+	interrupts();
+#else
+	detachPinInterrupts();
+#endif
+#endif
+}
+
+#if NEWENCODER_POLLING
+// Remove from the pollAll() or serviceStorms() list. nextPolled is kept, so a pollAll() / serviceStorms() that is
+// polling this encoder can carry on down the list. Call with interrupts disabled.
+void NewEncoder::unlinkFrom(NewEncoder *&listHead) {
+	for (NewEncoder **encoderPtr = &listHead; *encoderPtr != nullptr; encoderPtr = &(*encoderPtr)->nextPolled) {
+		if (*encoderPtr == this) {
+			*encoderPtr = nextPolled;
+			break;
+		}
+	}
+}
+#endif
 
+// Unlink this encoder's pin change functions and detach the interrupts no other encoder uses. Without functional ISRs,
+// call with interrupts disabled. It is then safe in interrupt context (see stormRejects()).
+void NewEncoder::detachPinInterrupts() {
 	int16_t _interruptA = digitalPinToInterrupt(_aPin);
 	int16_t _interruptB = digitalPinToInterrupt(_bPin);
+#ifndef USE_FUNCTIONAL_ISR
+	bool aIdle = unlinkIsr(_interruptA, PIN_A);
+	bool bIdle = unlinkIsr(_interruptB, PIN_B);
+	if (aIdle) {
+		detachInterrupt(_interruptA);
+	}
+	if (bIdle && (_interruptB != _interruptA)) {
+		detachInterrupt(_interruptB);
+	}
+#else
 	detachInterrupt(_interruptA);
 	detachInterrupt(_interruptB);
+	releaseInterrupt(_interruptA);
+	releaseInterrupt(_interruptB);
+#endif
+}
+
+bool NewEncoder::interruptClaimed(uint8_t intNumber) {
+	return (_claimedInterrupts[intNumber >> 3] & (1 << (intNumber & 7))) != 0;
+}
+
+// Take interrupt intNumber for code that attaches it itself. Returns false if it's out of range, claimed already, or
+// (without functional ISRs) linked to an encoder. An encoder's begin() then leaves the interrupt alone.
+bool NewEncoder::claimInterrupt(uint8_t intNumber) {
+	if (intNumber >= CORE_NUM_INTERRUPT) {
+		return false;
+	}
+	noInterrupts();
+	bool taken = interruptClaimed(intNumber);
+#ifndef USE_FUNCTIONAL_ISR
+#if NEWENCODER_SHARED_INTERRUPTS
+	taken = taken || (_isrChain[intNumber] != nullptr);
+#else
+	taken = taken || (_isrTable[intNumber].objectPtr != nullptr);
+#endif
+#endif
+	if (!taken) {
+		_claimedInterrupts[intNumber >> 3] |= 1 << (intNumber & 7);
+	}
+	interrupts();
+	return !taken;
+}
+
+void NewEncoder::releaseInterrupt(uint8_t intNumber) {
+	if (intNumber >= CORE_NUM_INTERRUPT) {
+		return;
+	}
+	noInterrupts();
+	_claimedInterrupts[intNumber >> 3] &= ~(1 << (intNumber & 7));
+	interrupts();
+}
+
+#ifndef USE_FUNCTIONAL_ISR
+// Have interrupt intNumber run functPtr on this encoder for its pin (PIN_A or PIN_B). Returns false and links nothing
+// if the interrupt is claimed (see claimInterrupt()) or, without shared interrupts, another encoder already has it.
+bool NewEncoder::linkIsr(uint8_t intNumber, uint8_t pin, PinChangeFunction functPtr) {
+#if NEWENCODER_SHARED_INTERRUPTS
+	isrLink &link = (pin == PIN_A) ? aPinLink : bPinLink;
+	link.objectPtr = this;
+	link.functPtr = functPtr;
+	noInterrupts();
+	if (interruptClaimed(intNumber)) {
+		interrupts();
+		return false;
+	}
+	link.next = _isrChain[intNumber];
+	_isrChain[intNumber] = &link;
+	interrupts();
+#else
+	(void) pin;
+	noInterrupts();
+	if ((_isrTable[intNumber].objectPtr != nullptr) || interruptClaimed(intNumber)) {
+		interrupts();
+		return false;
+	}
+	_isrTable[intNumber].functPtr = functPtr;
+	_isrTable[intNumber].objectPtr = this;
+	interrupts();
+#endif
+	return true;
+}
+
+// Returns true if no other encoder remains linked to the interrupt. Call with interrupts disabled.
+bool NewEncoder::unlinkIsr(uint8_t intNumber, uint8_t pin) {
+#if NEWENCODER_SHARED_INTERRUPTS
+	// link.next is kept, so a trampoline running this link (a storm detected in its ISR) carries on down the chain
+	isrLink &link = (pin == PIN_A) ? aPinLink : bPinLink;
+	for (isrLink **linkPtr = &_isrChain[intNumber]; *linkPtr != nullptr; linkPtr = &(*linkPtr)->next) {
+		if (*linkPtr == &link) {
+			*linkPtr = link.next;
+			break;
+		}
+	}
+	return _isrChain[intNumber] == nullptr;
+#else
+	(void) pin;
+	if (_isrTable[intNumber].objectPtr == this) {
+		_isrTable[intNumber].objectPtr = nullptr;
+	}
+	return _isrTable[intNumber].objectPtr == nullptr;
+#endif
 }
+#endif
 
-void NewEncoder::configure(uint8_t aPin, uint8_t bPin, int16_t minValue,
-		int16_t maxValue, int16_t initalValue, uint8_t type) {
+void NewEncoder::configure(uint8_t aPin, uint8_t bPin, EncoderValue minValue,
+		EncoderValue maxValue, EncoderValue initalValue, uint8_t type) {
 
 	if (active) {
 		end();
@@ -107,23 +380,48 @@ void NewEncoder::configure(uint8_t aPin, uint8_t bPin, int16_t minValue,
 	liveState.currentClick = NoClick;
 	memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
 	stateChanged = false;
+#if NEWENCODER_DETENT_DELTA
+	detentDelta = 0;
+#endif
+#if NEWENCODER_ATOMIC_STATE
+	__atomic_store_n(&publishedState, packState(initalValue, NoClick, false), __ATOMIC_RELEASE);
+#endif
 
 	if (type == HALF_PULSE) {
 		tablePtr = halfPulseTransitionTable;
+	} else if (type == QUAD_X4) {
+		tablePtr = quadX4TransitionTable;
+	} else if (type == QUAD_X2) {
+		tablePtr = quadX2TransitionTable;
 	} else {
 		tablePtr = fullPulseTransitionTable;
 	}
 	configured = true;
 }
 
+// Configure with any transition table, e.g. one generated by TransitionTableBuilder. A table other than the
+// built-in ones must start in the state whose code equals the B/A pin levels (see readPinState()).
+void NewEncoder::configure(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue,
+		EncoderValue initalValue, const encoderStateTransition (&table)[8]) {
+	configure(aPin, bPin, minValue, maxValue, initalValue, FULL_PULSE);
+	tablePtr = table;
+}
+
 bool NewEncoder::begin() {
-	if (active) {
-		return false;
+	if (portDriven) {
+		return false;  // Already decoded by a NewEncoderPort. Its edges would be counted twice.
 	}
-	if (!configured) {
+	if (!interruptsAvailable()) {
 		return false;
 	}
-	if (_aPin == _bPin) {
+	initPins();
+	delay(2);  // Seems to help ensure first reading after pinMode is correct
+	return startInterrupts();
+}
+
+// True if the configuration is valid and both pins have an interrupt this build can attach
+bool NewEncoder::interruptsAvailable() const {
+	if (!validConfiguration()) {
 		return false;
 	}
 
@@ -132,225 +430,1146 @@ bool NewEncoder::begin() {
 	InterruptNumberType _interruptA = static_cast<InterruptNumberType>(digitalPinToInterrupt(_aPin));
 	InterruptNumberType _interruptB = static_cast<InterruptNumberType>(digitalPinToInterrupt(_bPin));
 
-	if (_interruptA == _interruptB) {
-		return false;
-	}
 	if (_interruptA == NOT_AN_INTERRUPT) {
 		return false;
 	}
 	if (_interruptB == NOT_AN_INTERRUPT) {
 		return false;
 	}
-	if (_minValue >= _maxValue) {
+	if ((static_cast<uint16_t>(_interruptA) >= CORE_NUM_INTERRUPT) || (static_cast<uint16_t>(_interruptB) >= CORE_NUM_INTERRUPT)) {
 		return false;
 	}
-
-	pinMode(_aPin, INPUT_PULLUP);
-	pinMode(_bPin, INPUT_PULLUP);
-	delay(2);  // Seems to help ensure first reading after pinMode is correct
-	_aPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
-	_bPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
-	currentStateVariable = (_bPinValue << 1) | _aPinValue;
-	if ((tablePtr == halfPulseTransitionTable) && (currentStateVariable == (DETENT_1 & 0b11))) {
-		currentStateVariable = DETENT_1;
+	if (interruptClaimed(_interruptA) || interruptClaimed(_interruptB)) {
+		return false;
 	}
-
 #ifndef USE_FUNCTIONAL_ISR
-	_isrTable[_interruptA].objectPtr = this;
-	_isrTable[_interruptA].functPtr = &NewEncoder::aPinChange;
-	auto isrA = getIsr(_interruptA);
-	if (isrA == nullptr) {
+#if NEWENCODER_SHARED_INTERRUPTS
+	// The pins may share one interrupt. Both pin change functions are then linked to it.
+#else
+	// Each interrupt serves one pin of one encoder
+	if ((_interruptA == _interruptB) || (_isrTable[_interruptA].objectPtr != nullptr) || (_isrTable[_interruptB].objectPtr != nullptr)) {
 		return false;
 	}
-
-	_isrTable[_interruptB].objectPtr = this;
-	_isrTable[_interruptB].functPtr = &NewEncoder::bPinChange;
-	auto isrB = getIsr(_interruptB);
-	if (isrB == nullptr) {
+#endif
+#else
+	if (_interruptA == _interruptB) {
 		return false;
 	}
+#endif
+	return true;
+}
 
-	attachInterrupt(_interruptA, isrA, CHANGE);
-	attachInterrupt(_interruptB, isrB, CHANGE);
-
-#else
-	auto aPinIsr = [this] {
-		this->aPinChange();
-	};
-	attachInterrupt(_interruptA, aPinIsr, CHANGE);
-
-	auto bPinIsr = [this] {
-		this->bPinChange();
-	};
-	attachInterrupt(_interruptB, bPinIsr, CHANGE);
+// True if this encoder and 'other' have a pin interrupt in common
+bool NewEncoder::sharesInterrupt(const NewEncoder &other) const {
+	int16_t interruptA = digitalPinToInterrupt(_aPin);
+	int16_t interruptB = digitalPinToInterrupt(_bPin);
+	int16_t otherInterruptA = digitalPinToInterrupt(other._aPin);
+	int16_t otherInterruptB = digitalPinToInterrupt(other._bPin);
+	return (interruptA == otherInterruptA) || (interruptA == otherInterruptB) || (interruptB == otherInterruptA)
+			|| (interruptB == otherInterruptB);
+}
 
-#endif
+// Second half of begin(), once the pins have settled. interruptsAvailable() must be true. Returns false if an
+// interrupt was taken in between.
+bool NewEncoder::startInterrupts() {
+	readPinState();
+	if (!attachPinInterrupts()) {
+		return false;
+	}
 	active = true;
 	return true;
 }
 
-bool NewEncoder::getState(EncoderState &state) {
-	bool localStateChanged = stateChanged;
-	if (localStateChanged) {
+// Returns false, attaching nothing, if one of the interrupts is claimed or another encoder has it (without shared
+// interrupts)
+bool NewEncoder::attachPinInterrupts() {
+	using InterruptNumberType = decltype(NOT_AN_INTERRUPT);
+
+	InterruptNumberType _interruptA = static_cast<InterruptNumberType>(digitalPinToInterrupt(_aPin));
+	InterruptNumberType _interruptB = static_cast<InterruptNumberType>(digitalPinToInterrupt(_bPin));
+
+#ifndef USE_FUNCTIONAL_ISR
+	PinChangeFunction aFunctPtr = &NewEncoder::aPinChange;
+	PinChangeFunction bFunctPtr = &NewEncoder::bPinChange;
+	if (quadMode()) {
+		aFunctPtr = &NewEncoder::quadPinChange;
+		bFunctPtr = (_interruptB != _interruptA) ? &NewEncoder::quadPinChange : nullptr;  // quadPinChange() reads both pins. Link it once per interrupt.
+	} else if (bothPinSampling) {
+		aFunctPtr = &NewEncoder::aPinSync;
+		bFunctPtr = &NewEncoder::bPinSync;
+	}
+	if (!linkIsr(_interruptA, PIN_A, aFunctPtr)) {
+		return false;
+	}
+	if ((bFunctPtr != nullptr) && !linkIsr(_interruptB, PIN_B, bFunctPtr)) {
 		noInterrupts();
-		memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
-		stateChanged = false;
+		unlinkIsr(_interruptA, PIN_A);
 		interrupts();
-	} else {
-		localState.currentClick = NoClick;
+		return false;
 	}
-	memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
-	return localStateChanged;
-}
+	attachInterrupt(_interruptA, Trampolines::entries[_interruptA], CHANGE);
+	attachInterrupt(_interruptB, Trampolines::entries[_interruptB], CHANGE);
 
-bool NewEncoder::getAndSet(int16_t val, EncoderState &Oldstate, EncoderState &Newstate) {
-	bool changed;
-	if (val < _minValue) {
-		val = _minValue;
-	} else if (val > _maxValue) {
-		val = _maxValue;
+#else
+	if (!claimInterrupt(_interruptA)) {
+		return false;
 	}
-	noInterrupts();
-	changed = stateChanged;
-	stateChanged = false;
-	memcpy((void*) &Oldstate, (void*) &liveState, sizeof(EncoderState));
-	if (!changed) {
-		Oldstate.currentClick = NoClick;
+	if (!claimInterrupt(_interruptB)) {
+		releaseInterrupt(_interruptA);
+		return false;
 	}
-	liveState.currentValue = val;
-	liveState.currentClick = NoClick;
-	memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
-	interrupts();
-	memcpy((void*) &Newstate, (void*) &localState, sizeof(EncoderState));
-	return changed;
+	if (quadMode()) {
+		auto quadPinIsr = [this] {
+			this->quadPinChange();
+		};
+		attachInterrupt(_interruptA, quadPinIsr, CHANGE);
+		attachInterrupt(_interruptB, quadPinIsr, CHANGE);
+	} else if (bothPinSampling) {
+		auto aPinIsr = [this] {
+			this->aPinSync();
+		};
+		attachInterrupt(_interruptA, aPinIsr, CHANGE);
+
+		auto bPinIsr = [this] {
+			this->bPinSync();
+		};
+		attachInterrupt(_interruptB, bPinIsr, CHANGE);
+	} else {
+		auto aPinIsr = [this] {
+			this->aPinChange();
+		};
+		attachInterrupt(_interruptA, aPinIsr, CHANGE);
+
+		auto bPinIsr = [this] {
+			this->bPinChange();
+		};
+		attachInterrupt(_interruptB, bPinIsr, CHANGE);
+	}
+
+#endif
+	return true;
 }
 
-bool NewEncoder::newSettings(int16_t newMin, int16_t newMax, int16_t newCurrent, EncoderState &state) {
-	if (newMax <= newMin) {
+#if NEWENCODER_POLLING
+// Start the encoder without interrupts. Any pin DIRECT_PIN_READ can read may be used. The pins are sampled by
+// poll() / pollAll() (see pollAll() for where they may be called from).
+bool NewEncoder::beginPolling() {
+	if (portDriven) {
 		return false;
 	}
-	if (newCurrent < newMin) {
-		newCurrent = newMin;
-	}
-	if (newCurrent > newMax) {
-		newCurrent = newMax;
+	if (!validConfiguration()) {
+		return false;
 	}
+	initPins();
+	delay(2);  // Seems to help ensure first reading after pinMode is correct
+	readPinState();
+
+	uint32_t now = micros();
 	noInterrupts();
-	stateChanged = false;
-	liveState.currentValue = newCurrent;
-	liveState.currentClick = NoClick;
-	_minValue = newMin;
-	_maxValue = newMax;
-	memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+	lastPollTime = now;
+	lastPollChange = now;
+	pollMoving = false;
+	pollDriven = true;
+	nextPolled = polledEncoders;
+	polledEncoders = this;
+	active = true;
 	interrupts();
-	memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
 	return true;
 }
 
-bool NewEncoder::enabled() const {
-	return active;
+void NewEncoder::setPollIntervals(uint32_t fastMicros, uint32_t slowMicros, uint32_t idleMicros) {
+	if (slowMicros < fastMicros) {
+		slowMicros = fastMicros;
+	}
+	noInterrupts();
+	pollFastMicros = fastMicros;
+	pollSlowMicros = slowMicros;
+	pollIdleMicros = idleMicros;
+	interrupts();
 }
 
-void NewEncoder::attachCallback(EncoderCallBack cback, void *uPtr) {
-	callBackPtr = cback;
-	userPointer = uPtr;
+// Sample the pins if the current poll interval has elapsed. Returns the number of microseconds until the next
+// sample is due (0xFFFFFFFF if the encoder wasn't started with beginPolling()).
+uint32_t ESP_ISR NewEncoder::poll() {
+	if (!pollDriven || !active) {
+		return 0xFFFFFFFFUL;
+	}
+	return pollIfDue();
 }
 
-int16_t NewEncoder::setValue(int16_t val) {
-	if (val < _minValue) {
-		val = _minValue;
-	} else if (val > _maxValue) {
-		val = _maxValue;
+uint32_t ESP_ISR NewEncoder::pollIfDue() {
+	uint32_t now = micros();
+	uint32_t interval = pollMoving ? pollFastMicros : pollSlowMicros;
+	uint32_t elapsed = now - lastPollTime;
+	if (elapsed < interval) {
+		return interval - elapsed;
 	}
-#if defined(__AVR__)
-	noInterrupts();  // 16-bit access not atomic on 8-bit processor
-#endif
-	liveState.currentValue = val;
-#if defined(__AVR__)
-	interrupts();
-#endif
-	return val;
+	lastPollTime = now;
+	if (pollPins()) {
+		lastPollChange = now;
+		pollMoving = true;
+	} else if (pollMoving && ((now - lastPollChange) >= pollIdleMicros)) {
+		pollMoving = false;
+	}
+	return pollMoving ? pollFastMicros : pollSlowMicros;
 }
 
-int16_t NewEncoder::operator =(int16_t val) {
-	if (val < _minValue) {
+// poll() every encoder started with beginPolling(). Returns the number of microseconds until the next sample of any
+// of them is due. poll() / pollAll() only sample pins and run the decoder; they never attach or detach interrupts
+// or enable interrupts, on any platform. So they may be called from loop() or from a periodic timer interrupt, but
+// not from both. Encoders in an interrupt storm aren't on this list; serviceStorms() polls them.
+uint32_t ESP_ISR NewEncoder::pollAll() {
+	uint32_t nextDue = 0xFFFFFFFFUL;
+	for (NewEncoder *encoder = polledEncoders; encoder != nullptr; encoder = encoder->nextPolled) {
+		uint32_t due = encoder->poll();
+		if (due < nextDue) {
+			nextDue = due;
+		}
+	}
+	return nextDue;
+}
+#endif
+
+#if NEWENCODER_STORM_PROTECTION
+// Poll an encoder in a storm like poll(), detaching its interrupts first if its ISR couldn't (functional ISRs)
+uint32_t NewEncoder::serviceStorm() {
+#ifdef USE_FUNCTIONAL_ISR
+	if (stormState == STORM_DETACH_PENDING) {
+		detachPinInterrupts();
+		stormState = STORM_POLLING;
+	}
+#endif
+	uint32_t due = pollIfDue();
+	if ((micros() - lastPollChange) >= stormQuietMicros) {
+		leaveStorm();
+		return 0xFFFFFFFFUL;
+	}
+	return due;
+}
+
+// The storm is over: re-attach the pin interrupts. The polled levels are current, so decoding carries on. A change
+// between the last sample and the end of the storm, which the ISRs still ignore, is picked up by one more sample.
+// A claimInterrupt(), or without shared interrupts another encoder, may have taken an interrupt during the storm. This
+// one then stays polled.
+void NewEncoder::leaveStorm() {
+	if (!attachPinInterrupts()) {
+		return;
+	}
+	noInterrupts();
+	unlinkFrom(stormEncoders);
+	stormMillis += millis() - stormStartMillis;
+	stormEdges = 0;
+	stormWindowStart = micros();
+	stormState = STORM_NONE;
+	pollPins();
+	interrupts();
+}
+
+// Poll every encoder whose interrupts a storm has detached, and re-attach them once its pins have been still for
+// quietMicros. Returns the number of microseconds until the next sample of any of them is due (0xFFFFFFFF if there is
+// no storm). It attaches and detaches interrupts, so call it from loop(), never from an interrupt.
+uint32_t NewEncoder::serviceStorms() {
+	uint32_t nextDue = 0xFFFFFFFFUL;
+	for (NewEncoder *encoder = stormEncoders; encoder != nullptr; encoder = encoder->nextPolled) {
+		uint32_t due = encoder->serviceStorm();
+		if (due < nextDue) {
+			nextDue = due;
+		}
+	}
+	return nextDue;
+}
+#endif
+
+bool NewEncoder::validConfiguration() const {
+	if (active) {
+		return false;
+	}
+	if (!configured) {
+		return false;
+	}
+	if (_aPin == _bPin) {
+		return false;
+	}
+	if (_minValue >= _maxValue) {
+		return false;
+	}
+	return true;
+}
+
+void NewEncoder::initPins() {
+	pinMode(_aPin, INPUT_PULLUP);
+	pinMode(_bPin, INPUT_PULLUP);
+}
+
+bool NewEncoder::quadMode() const {
+	return (tablePtr == quadX4TransitionTable) || (tablePtr == quadX2TransitionTable);
+}
+
+void NewEncoder::readPinState() {
+	_aPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+	_bPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+	currentStateVariable = (_bPinValue << 1) | _aPinValue;
+	if ((tablePtr == halfPulseTransitionTable) && (currentStateVariable == 0b11)) {
+		currentStateVariable = 0b111;  // DETENT_1
+	}
+	lastPinChanged = 0;
+	lastStepDirection = 0;
+}
+
+bool NewEncoder::getState(EncoderState &state) {
+#if NEWENCODER_ATOMIC_STATE
+	// Clear the changed flag only in the exact word that was read. Retry if the ISR published in between.
+	PackedState packed = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+	while ((packed & ATOMIC_CHANGED_BIT) != 0) {
+		if (__atomic_compare_exchange_n(&publishedState, &packed, packed & ~ATOMIC_CHANGED_BIT, false, __ATOMIC_ACQ_REL,
+				__ATOMIC_ACQUIRE)) {
+			break;
+		}
+	}
+	unpackState(packed, state);
+	return (packed & ATOMIC_CHANGED_BIT) != 0;
+#else
+	bool localStateChanged = stateChanged;
+	if (localStateChanged) {
+		noInterrupts();
+		memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+		stateChanged = false;
+		interrupts();
+	} else {
+		localState.currentClick = NoClick;
+	}
+	memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
+	return localStateChanged;
+#endif
+}
+
+// Block the calling task until the state changes, then return it like getState(). Returns false if timeoutMillis
+// passed without a change. The task sleeps on a notification from the ISR on ESP32 (a condition variable in the
+// host build). Other platforms call yield() while they wait. Only one task may wait on an encoder at a time.
+bool NewEncoder::waitForChange(EncoderState &state, uint32_t timeoutMillis) {
+#if defined(ESP32) || defined(NEWENCODER_HOST)
+	// The timeout runs from here. After a wakeup without a change (see below), only what is left of it is waited.
+#if defined(ESP32)
+	TimeOut_t timeOut;
+	vTaskSetTimeOutState(&timeOut);
+	TickType_t waitTicks = (timeoutMillis == WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMillis);
+#else
+	uint32_t start = HostHal::wallMillis();
+	uint32_t waitMillis = timeoutMillis;
+#endif
+	for (;;) {
+		if (getState(state)) {
+			return true;
+		}
+#if defined(ESP32)
+		if (xTaskCheckForTimeOut(&timeOut, &waitTicks) == pdTRUE) {
+			return false;
+		}
+		__atomic_store_n(&waitingTask, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+#else
+		if (timeoutMillis != WAIT_FOREVER) {
+			uint32_t elapsed = HostHal::wallMillis() - start;
+			if (elapsed >= timeoutMillis) {
+				return false;
+			}
+			waitMillis = timeoutMillis - elapsed;
+		}
+		__atomic_store_n(&waiterArmed, true, __ATOMIC_RELEASE);
+#endif
+		bool changed = getState(state);  // Catch a change between the first check and arming
+		if (!changed) {
+#if defined(ESP32)
+			changed = ulTaskNotifyTakeIndexed(NEWENCODER_NOTIFY_INDEX, pdTRUE, waitTicks) != 0;
+#else
+			changed = changeNotification.take(waitMillis);
+#endif
+		}
+#if defined(ESP32)
+		__atomic_store_n(&waitingTask, nullptr, __ATOMIC_RELEASE);
+#else
+		__atomic_store_n(&waiterArmed, false, __ATOMIC_RELEASE);
+#endif
+		if (!changed) {
+			return getState(state);  // Timed out
+		}
+		// A notification left over from an earlier wait may wake this one without a change. Then wait again.
+	}
+#else
+	uint32_t start = millis();
+	while (!getState(state)) {
+		if ((timeoutMillis != WAIT_FOREVER) && ((millis() - start) >= timeoutMillis)) {
+			return false;
+		}
+		yield();
+	}
+	return true;
+#endif
+}
+
+bool NewEncoder::changePending() const {
+#if NEWENCODER_ATOMIC_STATE
+	return (__atomic_load_n(&publishedState, __ATOMIC_ACQUIRE) & ATOMIC_CHANGED_BIT) != 0;
+#else
+	return stateChanged;
+#endif
+}
+
+#if NEWENCODER_COROUTINES
+// co_await encoder.nextEvent() suspends the coroutine until the state changes. It is resumed by service() (or the
+// ESP32 service task), not in the ISR. If no deferred slot is free, it doesn't suspend.
+NewEncoder::ChangeAwaiter NewEncoder::nextEvent() {
+	return ChangeAwaiter(*this);
+}
+
+bool NewEncoder::suspendUntilChange(void *coroutine) {
+	if (!acquireDeferredSlot()) {
+		return false;
+	}
+	noInterrupts();
+	awaitingCoroutine = coroutine;
+	NEWENCODER_MEMORY_BARRIER();  // Publish the waiter before checking for a change it would have missed
+	bool missed = changePending();
+	if (missed) {
+		awaitingCoroutine = nullptr;
+	}
+	interrupts();
+	return !missed;
+}
+
+// Called by await_resume(). The slot goes back unless a deferred callback still uses it or the coroutine awaits again.
+void NewEncoder::finishAwait() {
+	if (!deferCallback && (awaitingCoroutine == nullptr)) {
+		releaseDeferredSlot();
+	}
+}
+#endif
+
+#if !NEWENCODER_ATOMIC_STATE
+// getState() into localState with interrupts already disabled, for NewEncoderGroup
+bool NewEncoder::latchState() {
+	bool localStateChanged = stateChanged;
+	if (localStateChanged) {
+		memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+		stateChanged = false;
+	} else {
+		localState.currentClick = NoClick;
+	}
+	return localStateChanged;
+}
+#endif
+
+bool NewEncoder::getAndSet(EncoderValue val, EncoderState &Oldstate, EncoderState &Newstate) {
+	bool changed;
+	if (val < _minValue) {
 		val = _minValue;
 	} else if (val > _maxValue) {
 		val = _maxValue;
 	}
-#if defined(__AVR__)
-	noInterrupts();  // 16-bit access not atomic on 8-bit processor
+#if NEWENCODER_ATOMIC_STATE
+	PackedState packed = __atomic_exchange_n(&publishedState, packState(val, NoClick, false), __ATOMIC_ACQ_REL);
+	unpackState(packed, Oldstate);
+	Newstate.currentValue = val;
+	Newstate.currentClick = NoClick;
+	changed = (packed & ATOMIC_CHANGED_BIT) != 0;
+#else
+	noInterrupts();
+	changed = stateChanged;
+	stateChanged = false;
+	memcpy((void*) &Oldstate, (void*) &liveState, sizeof(EncoderState));
+	if (!changed) {
+		Oldstate.currentClick = NoClick;
+	}
+	liveState.currentValue = val;
+	liveState.currentClick = NoClick;
+	memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+	interrupts();
+	memcpy((void*) &Newstate, (void*) &localState, sizeof(EncoderState));
+#endif
+	return changed;
+}
+
+#if NEWENCODER_DETENT_DELTA
+// Net detents (counts in the QUAD modes) since the last call, independent of the value's limits, getAndSet(),
+// newSettings(), updateValue(), and acceleration.
+int32_t NewEncoder::readAndClearDelta() {
+	uint32_t delta;
+#if NEWENCODER_ATOMIC_STATE
+	delta = __atomic_exchange_n(&detentDelta, 0, __ATOMIC_RELAXED);
+#else
+	noInterrupts();
+	delta = detentDelta;
+	detentDelta = 0;
+	interrupts();
+#endif
+	return static_cast<int32_t>(delta);
+}
+#endif
+
+bool NewEncoder::newSettings(EncoderValue newMin, EncoderValue newMax, EncoderValue newCurrent, EncoderState &state) {
+	if (newMax <= newMin) {
+		return false;
+	}
+	if (newCurrent < newMin) {
+		newCurrent = newMin;
+	}
+	if (newCurrent > newMax) {
+		newCurrent = newMax;
+	}
+#if NEWENCODER_ATOMIC_STATE
+	// Limits first, so an ISR that sees the new value also sees the new limits
+	_minValue = newMin;
+	_maxValue = newMax;
+	__atomic_store_n(&publishedState, packState(newCurrent, NoClick, false), __ATOMIC_RELEASE);
+	state.currentValue = newCurrent;
+	state.currentClick = NoClick;
+#else
+	noInterrupts();
+	stateChanged = false;
+	liveState.currentValue = newCurrent;
+	liveState.currentClick = NoClick;
+	_minValue = newMin;
+	_maxValue = newMax;
+	memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+	interrupts();
+	memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
+#endif
+	return true;
+}
+
+bool NewEncoder::enabled() const {
+	return active;
+}
+
+void NewEncoder::attachCallback(EncoderCallBack cback, void *uPtr) {
+	noInterrupts();
+#if NEWENCODER_DEFERRED
+	deferCallback = false;
+#endif
+	callBackPtr = cback;
+	userPointer = uPtr;
+	interrupts();
+#if NEWENCODER_COROUTINES
+	if (awaitingCoroutine != nullptr) {
+		return;  // Keep the slot for the coroutine
+	}
+#endif
+#if NEWENCODER_DEFERRED
+	releaseDeferredSlot();
+#endif
+}
+
+#if NEWENCODER_DEFERRED
+
+bool NewEncoder::attachDeferredCallback(EncoderCallBack cback, void *uPtr) {
+	if (!acquireDeferredSlot()) {
+		return false;
+	}
+	noInterrupts();
+	callBackPtr = cback;
+	userPointer = uPtr;
+	deferCallback = true;
+	interrupts();
+	return true;
+}
+
+// The test for a free slot and its claim are one atomic step, so encoders set up from two tasks (or cores) at once
+// can't take the same slot. noInterrupts() only excludes this core, so with NEWENCODER_ATOMIC_STATE the slot is
+// claimed with compare-and-swap.
+bool NewEncoder::acquireDeferredSlot() {
+	if (deferredSlot >= 0) {
+		return true;
+	}
+	for (uint8_t i = 0; i < NEWENCODER_MAX_DEFERRED; i++) {
+#if NEWENCODER_ATOMIC_STATE
+		NewEncoder *expected = nullptr;
+		if (__atomic_compare_exchange_n(&deferredEncoders[i], &expected, this, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+			deferredSlot = i;
+			return true;
+		}
+#else
+		noInterrupts();
+		bool claimed = (deferredEncoders[i] == nullptr);
+		if (claimed) {
+			deferredEncoders[i] = this;
+			deferredSlot = i;
+		}
+		interrupts();
+		if (claimed) {
+			return true;
+		}
+#endif
+	}
+	return false;
+}
+
+// noInterrupts() doesn't hold off an ISR on the other core (ESP32, RP2040). So the ISR must stop using the slot before
+// the slot is free for another encoder: deferCallback first, then deferredSlot, each published before the next step.
+void NewEncoder::releaseDeferredSlot() {
+	int8_t slot = deferredSlot;
+	if (slot < 0) {
+		return;
+	}
+	noInterrupts();
+	deferCallback = false;
+	NEWENCODER_MEMORY_BARRIER();
+	deferredSlot = -1;
+	NEWENCODER_MEMORY_BARRIER();
+	deferredEncoders[slot] = nullptr;
+#if NEWENCODER_ATOMIC_STATE
+	__atomic_fetch_and(&deferredPending, ~(1UL << slot), __ATOMIC_ACQ_REL);
+#else
+	deferredPending &= ~(1UL << slot);
+#endif
+	interrupts();
+}
+
+// Dispatch the callbacks of all encoders that changed since the last call, from the caller's (thread) context.
+// Any number of detents since the last call result in one callback with the latest state.
+uint8_t NewEncoder::service() {
+	uint32_t pending;
+#if NEWENCODER_ATOMIC_STATE
+	pending = __atomic_exchange_n(&deferredPending, 0, __ATOMIC_ACQ_REL);
+#else
+	noInterrupts();
+	pending = deferredPending;
+	deferredPending = 0;
+	interrupts();
+#endif
+	uint8_t dispatched = 0;
+	for (uint8_t slot = 0; pending != 0; slot++, pending >>= 1) {
+		if (((pending & 1) != 0) && (deferredEncoders[slot] != nullptr)) {
+			deferredEncoders[slot]->dispatchDeferred();
+			dispatched++;
+		}
+	}
+	return dispatched;
+}
+
+#if defined(ESP32)
+// Dedicated task that runs service() whenever an ISR marks a deferred callback pending
+bool NewEncoder::startServiceTask(uint32_t stackDepth, UBaseType_t priority, BaseType_t coreId) {
+	if (serviceTaskHandle != nullptr) {
+		return false;
+	}
+	TaskHandle_t handle;
+	if (xTaskCreatePinnedToCore(serviceTask, "NewEncoder", stackDepth, nullptr, priority, &handle, coreId) != pdPASS) {
+		return false;
+	}
+	serviceTaskHandle = handle;
+	return true;
+}
+
+void NewEncoder::serviceTask(void *pvParameters) {
+	(void) pvParameters;
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // Clears all notifications given since the last pass - coalesces wakeups
+		service();
+	}
+}
+#endif
+
+void NewEncoder::dispatchDeferred() {
+#if NEWENCODER_COROUTINES
+	void *coroutine = awaitingCoroutine;
+	if (coroutine != nullptr) {
+		awaitingCoroutine = nullptr;  // It may await again before resume() returns
+		std::coroutine_handle<>::from_address(coroutine).resume();
+	}
+#endif
+	EncoderCallBack cback = callBackPtr;
+	if ((cback == nullptr) || !deferCallback) {
+		return;
+	}
+	// Latest state without consuming the changed flag that getState() reports
+	EncoderState state;
+#if NEWENCODER_ATOMIC_STATE
+	PackedState packed = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+	state.currentValue = unpackValue(packed);
+	state.currentClick = static_cast<EncoderClick>((packed >> ATOMIC_CLICK_SHIFT) & 0b11);
+#else
+	noInterrupts();
+	memcpy((void*) &state, (void*) &liveState, sizeof(EncoderState));
+	interrupts();
+#endif
+	cback(this, &state, userPointer);
+}
+#endif
+
+#if NEWENCODER_EVENT_QUEUE
+void NewEncoder::attachEventQueue(EventQueue *queue) {
+	noInterrupts();
+	eventQueue = queue;
+	interrupts();
+}
+
+uint8_t NewEncoder::readEvents(EncoderEvent *buffer, uint8_t maxEvents) {
+	if (eventQueue == nullptr) {
+		return 0;
+	}
+	return eventQueue->read(buffer, maxEvents);
+}
+
+uint32_t NewEncoder::getEventOverflows() const {
+	if (eventQueue == nullptr) {
+		return 0;
+	}
+	return eventQueue->overflows();
+}
+#endif
+
+#if NEWENCODER_TRACE
+// Record every level change of the pins seen by the ISRs in the ring (nullptr stops recording). The encoder must be
+// configured. The first record is the current levels.
+void NewEncoder::attachTrace(TraceRing *ring) {
+	noInterrupts();
+	traceRing = ring;
+	if (ring != nullptr) {
+		ring->start((DIRECT_PIN_READ(_bPin_register, _bPin_bitmask) << 1) | DIRECT_PIN_READ(_aPin_register, _aPin_bitmask));
+	}
+	interrupts();
+}
+#endif
+
+#if NEWENCODER_TRANSITION_COUNTS
+uint32_t NewEncoder::getInvalidTransitions() const {
+#if defined(__AVR__)
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = invalidTransitions;
+	interrupts();
+	return count;
+#else
+	return invalidTransitions;
+#endif
+}
+
+uint32_t NewEncoder::getInferredTransitions() const {
+#if defined(__AVR__)
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = inferredTransitions;
+	interrupts();
+	return count;
+#else
+	return inferredTransitions;
+#endif
+}
+#endif
+
+#if NEWENCODER_GLITCH_FILTER
+// Drop pin changes that follow the pin's last accepted change by less than minEdgeMicros (contact chatter).
+// 0 disables the filter.
+void NewEncoder::setGlitchFilter(uint32_t minEdgeMicros) {
+	uint32_t ticksPerMicro = NEWENCODER_FILTER_TICKS_PER_MICRO;
+	if (minEdgeMicros > (0x7FFFFFFFUL / ticksPerMicro)) {
+		minEdgeMicros = 0x7FFFFFFFUL / ticksPerMicro;  // Half the timer's range, so elapsed times can't wrap into the window
+	}
+	uint32_t ticks = minEdgeMicros * ticksPerMicro;
+	uint32_t now = NEWENCODER_FILTER_TIMER();
+	noInterrupts();
+	lastAEdgeTime = now - ticks;
+	lastBEdgeTime = now - ticks;
+	filterPending = 0;
+	filterTicks = ticks;
+	interrupts();
+}
+
+uint32_t NewEncoder::getFilteredEdges() const {
+#if defined(__AVR__)
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = filteredEdges;
+	interrupts();
+	return count;
+#else
+	return filteredEdges;
+#endif
+}
+#endif
+
+// FULL_PULSE / HALF_PULSE: read both pins in either pin's ISR. Takes effect at the next begin().
+void NewEncoder::setBothPinSampling(bool enable) {
+	bothPinSampling = enable;
+}
+
+#if NEWENCODER_STORM_PROTECTION
+// Interrupt-storm protection. More than maxEdges pin interrupts within windowMicros (e.g. from a floating or
+// chattering line) detach the encoder's interrupts and hand it to serviceStorms(). The interrupts are re-attached once
+// the pins have been still for quietMicros. 0 disables. Call serviceStorms() from loop().
+void NewEncoder::setStormProtection(uint16_t maxEdges, uint32_t windowMicros, uint32_t quietMicros) {
+	uint32_t now = micros();
+	noInterrupts();
+	stormMaxEdges = maxEdges;
+	stormWindowMicros = windowMicros;
+	stormQuietMicros = quietMicros;
+	stormEdges = 0;
+	stormWindowStart = now;
+	interrupts();
+}
+
+// True while a storm has the encoder polled
+bool NewEncoder::stormActive() const {
+	return stormState != STORM_NONE;
+}
+
+uint32_t NewEncoder::getStorms() const {
+#if defined(__AVR__)
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = storms;
+	interrupts();
+	return count;
+#else
+	return storms;
+#endif
+}
+
+// Total time polled because of storms, including the current one
+uint32_t NewEncoder::getStormMillis() const {
+	uint32_t total;
+	noInterrupts();
+	total = stormMillis;
+	if (stormState != STORM_NONE) {
+		total += millis() - stormStartMillis;
+	}
+	interrupts();
+	return total;
+}
+#endif
+
+#if NEWENCODER_RATE
+void NewEncoder::setRateUnits(RateUnits units, uint32_t timeoutMicros) {
+	if (timeoutMicros > (0xFFFFFFFFUL >> RATE_FRACTION_BITS)) {
+		timeoutMicros = 0xFFFFFFFFUL >> RATE_FRACTION_BITS;  // Keep the fixed-point period from overflowing
+	}
+	noInterrupts();
+	rateUnits = units;
+	rateTimeoutMicros = timeoutMicros;
+	rateSamples = 0;
+	rateDirection = 0;
+	interrupts();
+}
+
+float NewEncoder::getRate() {
+	uint32_t period, lastTime;
+	uint8_t samples;
+	int8_t direction;
+
+	noInterrupts();
+	period = filteredPeriod;
+	lastTime = lastRateTime;
+	samples = rateSamples;
+	direction = rateDirection;
+	interrupts();
+
+	if ((samples < 2) || (direction == 0)) {
+		return 0.0f;
+	}
+	uint32_t idle = micros() - lastTime;
+	if (idle > rateTimeoutMicros) {
+		return 0.0f;
+	}
+	// No event for longer than the filtered period means the encoder is slowing down. Decay toward zero.
+	float periodMicros = static_cast<float>(period) / (1UL << RATE_FRACTION_BITS);
+	if (idle > periodMicros) {
+		periodMicros = idle;
+	}
+	if (periodMicros < 1.0f) {
+		periodMicros = 1.0f;  // Events in the same microsecond, or just reset: micros() can't resolve a shorter period
+	}
+	return direction * (1000000.0f / periodMicros);
+}
+#endif
+
+#if NEWENCODER_STATS
+void NewEncoder::readStats(EncoderStats &stats) {
+	StatsSequence sequence;
+	do {
+		sequence = statsSequence;
+		STATS_FENCE();
+		memcpy((void*) &stats, (void*) &liveStats, sizeof(EncoderStats));
+		STATS_FENCE();
+	} while (((sequence & 1) != 0) || (sequence != statsSequence));
+}
+
+void NewEncoder::getStats(EncoderStats &stats) {
+	// Counters are never cleared by the reader. resetStats() records a baseline that is subtracted here.
+	readStats(stats);
+	stats.edges -= statsBaseline.edges;
+	stats.noOpEdges -= statsBaseline.noOpEdges;
+	stats.filteredEdges -= statsBaseline.filteredEdges;
+	stats.illegalTransitions -= statsBaseline.illegalTransitions;
+	stats.detents -= statsBaseline.detents;
+	for (uint8_t i = 0; i < NEWENCODER_STATS_BUCKETS; i++) {
+		stats.isrHistogram[i] -= statsBaseline.isrHistogram[i];
+		stats.callbackHistogram[i] -= statsBaseline.callbackHistogram[i];
+	}
+}
+
+void NewEncoder::resetStats() {
+	readStats(statsBaseline);
+}
 #endif
-	liveState.currentValue = val;
+
+#if NEWENCODER_EVENT_QUEUE
+uint8_t NewEncoder::EventQueue::available() const {
+	return static_cast<uint8_t>(head - tail);
+}
+
+uint8_t NewEncoder::EventQueue::read(EncoderEvent *dest, uint8_t maxEvents) {
+	uint8_t localTail = tail;
+	uint8_t count = static_cast<uint8_t>(head - localTail);
+	NEWENCODER_MEMORY_BARRIER();  // Read head before the events it publishes
+	if (count > maxEvents) {
+		count = maxEvents;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		dest[i] = buffer[static_cast<uint8_t>(localTail + i) & mask];
+	}
+	NEWENCODER_MEMORY_BARRIER();  // Finish copying before releasing the slots
+	tail = localTail + count;
+	return count;
+}
+
+uint32_t NewEncoder::EventQueue::overflows() const {
 #if defined(__AVR__)
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = overflowCount;
 	interrupts();
+	return count;
+#else
+	return overflowCount;
 #endif
-	return val;
 }
 
-int16_t NewEncoder::getValue() {
+void ESP_ISR NewEncoder::EventQueue::push(uint32_t timestamp, EncoderValue value, int8_t delta) {
+	uint8_t localHead = head;
+	if (static_cast<uint8_t>(localHead - tail) > mask) {
+		overflowCount++;
+		return;
+	}
+	EncoderEvent &event = buffer[localHead & mask];
+	event.timestamp = timestamp;
+	event.value = value;
+	event.delta = delta;
+	NEWENCODER_MEMORY_BARRIER();  // Publish the event before advancing head
+	head = localHead + 1;
+}
+#endif
+
+#if NEWENCODER_TRACE
+uint32_t NewEncoder::TraceRing::recorded() const {
 #if defined(__AVR__)
-	int16_t val;
-	noInterrupts();  // 16-bit access not atomic on 8-bit processor
-	val = liveState.currentValue;
+	uint32_t count;
+	noInterrupts();  // 32-bit access not atomic on 8-bit processor
+	count = written;
 	interrupts();
-	return val;
+	return count;
 #else
-	return liveState.currentValue;
+	return written;
 #endif
 }
 
-NewEncoder::operator int16_t() const {
-#if defined(__AVR__)
-	int16_t val;
-	noInterrupts();  // 16-bit access not atomic on 8-bit processor
-	val = liveState.currentValue;
+void NewEncoder::TraceRing::clear() {
+	noInterrupts();
+	written = 0;
+	interrupts();
+}
+
+static size_t dumpWord(Print &out, uint32_t word) {
+	uint8_t bytes[4] = { static_cast<uint8_t>(word), static_cast<uint8_t>(word >> 8), static_cast<uint8_t>(word >> 16),
+			static_cast<uint8_t>(word >> 24) };
+	return out.write(bytes, sizeof(bytes));
+}
+
+// Binary dump, all words little-endian: magic, version / 3 reserved bytes, timer ticks per microsecond, records
+// written since clear(), records that follow. Then the retained records, oldest first. Capture is paused meanwhile.
+size_t NewEncoder::TraceRing::dump(Print &out) {
+	bool wasCapturing = capturing;
+	capturing = false;
+	NEWENCODER_MEMORY_BARRIER();  // Stop the ISR before reading the ring
+	uint32_t total = recorded();
+	uint32_t count = (total > mask) ? static_cast<uint32_t>(mask) + 1 : total;
+
+	size_t bytes = dumpWord(out, DUMP_MAGIC);
+	bytes += dumpWord(out, DUMP_VERSION);
+	bytes += dumpWord(out, NEWENCODER_FILTER_TICKS_PER_MICRO);
+	bytes += dumpWord(out, total);
+	bytes += dumpWord(out, count);
+	for (uint32_t index = total - count; index != total; index++) {
+		bytes += dumpWord(out, buffer[index & mask]);
+	}
+
+	NEWENCODER_MEMORY_BARRIER();
+	capturing = wasCapturing;
+	return bytes;
+}
+
+void NewEncoder::TraceRing::start(uint8_t levels) {
+	lastLevels = levels;
+	lastTime = NEWENCODER_FILTER_TIMER();
+	buffer[written & mask] = levels;  // First record, the starting levels
+	written = written + 1;
+	capturing = true;
+}
+
+// Only called when a pin in pinMask may have changed. Costs a level compare when it hasn't.
+void ESP_ISR NewEncoder::TraceRing::push(uint8_t pinMask, uint8_t levels) {
+	uint8_t newLevels = (lastLevels & ~pinMask) | levels;
+	if ((newLevels == lastLevels) || !capturing) {
+		return;
+	}
+	uint32_t now = NEWENCODER_FILTER_TIMER();
+	uint32_t elapsed = now - lastTime;
+	if (elapsed > MAX_TICKS) {
+		elapsed = MAX_TICKS;
+	}
+	lastTime = now;
+	lastLevels = newLevels;
+	uint32_t index = written;
+	buffer[index & mask] = (elapsed << TIME_SHIFT) | newLevels;
+	written = index + 1;
+}
+#endif
+
+#if NEWENCODER_ACCELERATION
+void NewEncoder::setAcceleration(const AccelerationStep *curve, uint8_t numSteps) {
+	noInterrupts();
+	accelerationCurve = (numSteps == 0) ? nullptr : curve;
+	accelerationSteps = numSteps;
+	lastDetentDelta = 0;
+	detentStep = 1;
 	interrupts();
+}
+#endif
+
+NewEncoder::EncoderValue NewEncoder::setValue(EncoderValue val) {
+	if (val < _minValue) {
+		val = _minValue;
+	} else if (val > _maxValue) {
+		val = _maxValue;
+	}
+#if NEWENCODER_ATOMIC_STATE
+	exchangeValue(val);
+#else
+	if (valueNeedsCriticalSection) {
+		noInterrupts();  // Multi-byte access not atomic on this processor
+	}
+	liveState.currentValue = val;
+	if (valueNeedsCriticalSection) {
+		interrupts();
+	}
+#endif
+	return val;
+}
+
+NewEncoder::EncoderValue NewEncoder::operator =(EncoderValue val) {
+	if (val < _minValue) {
+		val = _minValue;
+	} else if (val > _maxValue) {
+		val = _maxValue;
+	}
+#if NEWENCODER_ATOMIC_STATE
+	exchangeValue(val);
+#else
+	if (valueNeedsCriticalSection) {
+		noInterrupts();  // Multi-byte access not atomic on this processor
+	}
+	liveState.currentValue = val;
+	if (valueNeedsCriticalSection) {
+		interrupts();
+	}
+#endif
 	return val;
+}
+
+NewEncoder::EncoderValue NewEncoder::getValue() {
+	return peekValue();
+}
+
+NewEncoder::operator EncoderValue() const {
+	return peekValue();
+}
+
+// Current value without clearing the changed flag that getState() reports
+NewEncoder::EncoderValue NewEncoder::peekValue() const {
+#if NEWENCODER_ATOMIC_STATE
+	return unpackValue(__atomic_load_n(&publishedState, __ATOMIC_ACQUIRE));
 #else
-	return liveState.currentValue;
+	EncoderValue val;
+	if (valueNeedsCriticalSection) {
+		noInterrupts();  // Multi-byte access not atomic on this processor
+	}
+	val = liveState.currentValue;
+	if (valueNeedsCriticalSection) {
+		interrupts();
+	}
+	return val;
 #endif
 }
 
-int16_t NewEncoder::getAndSet(int16_t val) {
-	int16_t localCurrentValue;
+NewEncoder::EncoderValue NewEncoder::getAndSet(EncoderValue val) {
+	EncoderValue localCurrentValue;
 	if (val < _minValue) {
 		val = _minValue;
 	} else if (val > _maxValue) {
 		val = _maxValue;
 	}
+#if NEWENCODER_ATOMIC_STATE
+	localCurrentValue = unpackValue(exchangeValue(val));
+#else
 	noInterrupts()
 	;
 	localCurrentValue = liveState.currentValue;
 	liveState.currentValue = val;
 	interrupts()
 	;
+#endif
 	return localCurrentValue;
 }
 
+#if NEWENCODER_CLICK_FLAGS
 bool NewEncoder::upClick() {
+#if NEWENCODER_COMPACT
+	noInterrupts();  // The flags share a byte written by the ISR
+	bool click = clickUp;
+	clickUp = false;
+	interrupts();
+	return click;
+#else
 	if (clickUp) {
 		clickUp = false;
 		return true;
 	} else {
 		return false;
 	}
+#endif
 }
 
 bool NewEncoder::downClick() {
+#if NEWENCODER_COMPACT
+	noInterrupts();  // The flags share a byte written by the ISR
+	bool click = clickDown;
+	clickDown = false;
+	interrupts();
+	return click;
+#else
 	if (clickDown) {
 		clickDown = false;
 		return true;
 	} else {
 		return false;
 	}
+#endif
 }
+#endif
 
-bool NewEncoder::newSettings(int16_t newMin, int16_t newMax, int16_t newCurrent) {
+bool NewEncoder::newSettings(EncoderValue newMin, EncoderValue newMax, EncoderValue newCurrent) {
 	bool success = false;
-#if defined(__AVR__)
-	noInterrupts();  // 16-bit access not atomic on 8-bit processor
-#endif
+	if (valueNeedsCriticalSection) {
+		noInterrupts();  // Multi-byte access not atomic on this processor
+	}
 	if (active) {
 		if (newMax > newMin) {
 			if (newCurrent < newMin) {
@@ -358,66 +1577,546 @@ bool NewEncoder::newSettings(int16_t newMin, int16_t newMax, int16_t newCurrent)
 			} else if (newCurrent > newMax) {
 				newCurrent = newMax;
 			}
+#if NEWENCODER_ATOMIC_STATE
+			_minValue = newMin;
+			_maxValue = newMax;
+			exchangeValue(newCurrent);
+#else
 			liveState.currentValue = newCurrent;
 			_minValue = newMin;
 			_maxValue = newMax;
+#endif
 			success = true;
 		}
 	}
-#if defined(__AVR__)
-	interrupts();
-#endif
+	if (valueNeedsCriticalSection) {
+		interrupts();
+	}
 	return success;
 }
 
 void ESP_ISR NewEncoder::aPinChange() {
+	RETURN_IF_STORM();
+	STATS_ISR_BEGIN();
 	uint8_t newPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+	TRACE_PUSH(0b01, newPinValue);
 	if (newPinValue == _aPinValue) {
-		return;
+		STATS_INCREMENT(noOpEdges);
+#if NEWENCODER_GLITCH_FILTER
+	} else if ((filterTicks != 0) && filterRejects(lastAEdgeTime, FILTER_PENDING_A)) {
+		filteredEdges++;
+		STATS_INCREMENT(filteredEdges);
+#endif
+	} else {
+#if NEWENCODER_GLITCH_FILTER
+		if (filterPending != 0) {
+			settleFilteredPins(FILTER_PENDING_B);
+		}
+#endif
+		_aPinValue = newPinValue;
+		pinChangeHandler(0b00 | _aPinValue);  // Falling aPin == 0b00, Rising aPin = 0b01;
 	}
-	_aPinValue = newPinValue;
-	pinChangeHandler(0b00 | _aPinValue);  // Falling aPin == 0b00, Rising aPin = 0b01;
+	STATS_ISR_END();
 }
 
 void ESP_ISR NewEncoder::bPinChange() {
+	RETURN_IF_STORM();
+	STATS_ISR_BEGIN();
 	uint8_t newPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+	TRACE_PUSH(0b10, newPinValue << 1);
 	if (newPinValue == _bPinValue) {
+		STATS_INCREMENT(noOpEdges);
+#if NEWENCODER_GLITCH_FILTER
+	} else if ((filterTicks != 0) && filterRejects(lastBEdgeTime, FILTER_PENDING_B)) {
+		filteredEdges++;
+		STATS_INCREMENT(filteredEdges);
+#endif
+	} else {
+#if NEWENCODER_GLITCH_FILTER
+		if (filterPending != 0) {
+			settleFilteredPins(FILTER_PENDING_A);
+		}
+#endif
+		_bPinValue = newPinValue;
+		pinChangeHandler(0b10 | _bPinValue);  // Falling bPin == 0b10, Rising bPin = 0b11;
+	}
+	STATS_ISR_END();
+}
+
+#if NEWENCODER_STORM_PROTECTION
+// Storm protection: counts the pin interrupts in the current window. True if this one is to be ignored: the limit was
+// just exceeded, or the interrupts are being detached. Without functional ISRs, they are detached right here, so no
+// further interrupt costs the main loop anything. Otherwise, the next serviceStorms() detaches them.
+bool ESP_ISR NewEncoder::stormRejects() {
+	if (stormState != STORM_NONE) {
+		return true;
+	}
+	uint32_t now = micros();
+	if ((now - stormWindowStart) >= stormWindowMicros) {
+		stormWindowStart = now;
+		stormEdges = 0;
+	}
+	if (++stormEdges <= stormMaxEdges) {
+		return false;
+	}
+	storms++;
+	stormStartMillis = millis();
+#ifndef USE_FUNCTIONAL_ISR
+	detachPinInterrupts();
+	stormState = STORM_POLLING;
+#else
+	stormState = STORM_DETACH_PENDING;
+#endif
+	lastPollTime = now;
+	lastPollChange = now;
+	pollMoving = true;
+	nextPolled = stormEncoders;
+	stormEncoders = this;
+	return true;
+}
+#endif
+
+// QUAD_X4 / QUAD_X2: both pins' ISRs. The table is indexed by the new B/A levels.
+void ESP_ISR NewEncoder::quadPinChange() {
+	RETURN_IF_STORM();
+	STATS_ISR_BEGIN();
+	uint8_t newLevels = (DIRECT_PIN_READ(_bPin_register, _bPin_bitmask) << 1) | DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+	TRACE_PUSH(0b11, newLevels);
+	if (newLevels == currentStateVariable) {
+		STATS_INCREMENT(noOpEdges);
+#if NEWENCODER_GLITCH_FILTER
+	} else if ((filterTicks != 0) && filterRejects(lastAEdgeTime, newLevels ^ currentStateVariable)) {
+		// Both pins are read on every interrupt. So, the next accepted one also picks up a dropped final level.
+		filteredEdges++;
+		STATS_INCREMENT(filteredEdges);
+#endif
+	} else {
+#if NEWENCODER_GLITCH_FILTER
+		uint8_t pending = filterPending;
+		filterPending = 0;
+		if (((newLevels ^ currentStateVariable) == 0b11) && (pending != 0) && (pending != 0b11)) {
+			// One of the two changes is a dropped one (e.g. a spike's trailing edge). Apply it first.
+			quadSample(currentStateVariable ^ pending);
+		}
+#endif
+		quadSample(newLevels);
+	}
+	STATS_ISR_END();
+}
+
+// QUAD modes: apply a sample of both pins. If both changed since the last sample, an edge was missed. It is replayed
+// in the direction of the last single step, if known. Otherwise, the table counts an invalid transition and the state
+// re-synchronizes to the pins.
+void ESP_ISR NewEncoder::quadSample(uint8_t newLevels) {
+	uint8_t changed = newLevels ^ currentStateVariable;
+	uint8_t parity = (currentStateVariable ^ (currentStateVariable >> 1)) & 0b01;
+	uint8_t clockwisePin = parity ? PIN_B : PIN_A;  // Gray code B/A = 00 -> 01 -> 11 -> 10 -> 00 counts up
+	if (changed == 0b11) {
+		if (lastStepDirection != 0) {
+			COUNT_TRANSITION(inferredTransitions);
+			pinChangeHandler(currentStateVariable ^ ((lastStepDirection > 0) ? clockwisePin : (clockwisePin ^ 0b11)));
+		}
+	} else if (changed > 0b11) {
+		lastStepDirection = 0;  // Re-synchronizing from an unused state
+	} else if (changed != 0) {
+		lastStepDirection = (changed == clockwisePin) ? 1 : -1;
+	}
+	pinChangeHandler(newLevels);
+}
+
+// FULL_PULSE / HALF_PULSE with both-pin sampling. Either pin's ISR reads both pins (one register load if they share a
+// port) and applies every change since the last sample. When interrupts were held off, both pins may have changed
+// and the ISRs then run in priority order, not in the order of the changes. With the glitch filter, the per-pin
+// ISRs are used.
+void ESP_ISR NewEncoder::aPinSync() {
+#if NEWENCODER_GLITCH_FILTER
+	if (filterTicks != 0) {
+		aPinChange();
+		return;
+	}
+#endif
+	syncPins();
+}
+
+void ESP_ISR NewEncoder::bPinSync() {
+#if NEWENCODER_GLITCH_FILTER
+	if (filterTicks != 0) {
+		bPinChange();
 		return;
 	}
-	_bPinValue = newPinValue;
-	pinChangeHandler(0b10 | _bPinValue);  // Falling bPin == 0b10, Rising bPin = 0b11;
+#endif
+	syncPins();
+}
+
+void ESP_ISR NewEncoder::syncPins() {
+	RETURN_IF_STORM();
+	STATS_ISR_BEGIN();
+	uint8_t newAPinValue, newBPinValue;
+#ifdef DIRECT_PORT_READ
+	if (_aPin_register == _bPin_register) {
+		IO_REG_TYPE snapshot = DIRECT_PORT_READ(_aPin_register);
+		newAPinValue = (snapshot & _aPin_bitmask) ? 1 : 0;
+		newBPinValue = (snapshot & _bPin_bitmask) ? 1 : 0;
+	} else
+#endif
+	{
+		newAPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+		newBPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+	}
+	TRACE_PUSH(0b11, (newBPinValue << 1) | newAPinValue);
+	if ((newAPinValue == _aPinValue) && (newBPinValue == _bPinValue)) {
+		STATS_INCREMENT(noOpEdges);  // Already applied by the other pin's ISR
+	} else {
+		applyPinLevels(newAPinValue, newBPinValue);
+	}
+	STATS_ISR_END();
+}
+
+// FULL_PULSE / HALF_PULSE: apply a sample of both pins. If both changed since the last sample, an edge was missed.
+// They are applied in the order that continues the rotation: the pin that changed last (lastPinChanged) goes second.
+// If that isn't known, the order is a guess and the invalid transition is counted.
+void ESP_ISR NewEncoder::applyPinLevels(uint8_t newAPinValue, uint8_t newBPinValue) {
+	uint8_t changed = ((newBPinValue ^ _bPinValue) << 1) | (newAPinValue ^ _aPinValue);
+	if (changed == 0b11) {
+		if (lastPinChanged != 0) {
+			COUNT_TRANSITION(inferredTransitions);
+		} else {
+			COUNT_TRANSITION(invalidTransitions);
+			STATS_INCREMENT(illegalTransitions);
+		}
+	}
+	if ((changed & PIN_A) && (lastPinChanged != PIN_A)) {
+		_aPinValue = newAPinValue;
+		pinChangeHandler(0b00 | newAPinValue);
+		changed &= ~PIN_A;
+		lastPinChanged = PIN_A;
+	}
+	if (changed & PIN_B) {
+		_bPinValue = newBPinValue;
+		pinChangeHandler(0b10 | newBPinValue);
+		lastPinChanged = PIN_B;
+	}
+	if (changed & PIN_A) {
+		_aPinValue = newAPinValue;
+		pinChangeHandler(0b00 | newAPinValue);
+		lastPinChanged = PIN_A;
+	}
 }
 
+#if NEWENCODER_GLITCH_FILTER
+// Glitch filter: true if this change is within filterTicks of the pin's last accepted change
+bool ESP_ISR NewEncoder::filterRejects(volatile uint32_t &lastEdgeTime, uint8_t pendingBit) {
+	uint32_t now = NEWENCODER_FILTER_TIMER();
+	if ((now - lastEdgeTime) < filterTicks) {
+		filterPending |= pendingBit;
+		return true;
+	}
+	lastEdgeTime = now;
+	return false;
+}
+
+// A dropped change may have been the pin's last one (e.g. the trailing edge of a spike). No further interrupt
+// will come from that pin. So, apply its current level before an accepted change of the other pin.
+void ESP_ISR NewEncoder::settleFilteredPins(uint8_t settleMask) {
+	uint8_t pending = filterPending & settleMask;
+	filterPending = 0;
+	if ((pending & FILTER_PENDING_A) != 0) {
+		uint8_t newPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+		TRACE_PUSH(0b01, newPinValue);
+		if (newPinValue != _aPinValue) {
+			_aPinValue = newPinValue;
+			pinChangeHandler(0b00 | _aPinValue);
+		}
+	}
+	if ((pending & FILTER_PENDING_B) != 0) {
+		uint8_t newPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+		TRACE_PUSH(0b10, newPinValue << 1);
+		if (newPinValue != _bPinValue) {
+			_bPinValue = newPinValue;
+			pinChangeHandler(0b10 | _bPinValue);
+		}
+	}
+}
+#endif
+
+#if NEWENCODER_POLLING
+// Polling backend: both pins are sampled together. Returns true if either one changed since the last sample.
+bool ESP_ISR NewEncoder::pollPins() {
+	uint8_t newAPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+	uint8_t newBPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+	if ((newAPinValue == _aPinValue) && (newBPinValue == _bPinValue)) {
+		return false;
+	}
+	STATS_ISR_BEGIN();
+	TRACE_PUSH(0b11, (newBPinValue << 1) | newAPinValue);
+	if (quadMode()) {
+		_aPinValue = newAPinValue;
+		_bPinValue = newBPinValue;
+		quadSample((newBPinValue << 1) | newAPinValue);
+	} else {
+		applyPinLevels(newAPinValue, newBPinValue);
+	}
+	STATS_ISR_END();
+	return true;
+}
+#endif
+
+#ifdef DIRECT_PORT_READ
+void ESP_ISR NewEncoder::portSample(IO_REG_TYPE snapshot) {
+	STATS_ISR_BEGIN();
+	TRACE_PUSH(0b11, (((snapshot & _bPin_bitmask) ? 1 : 0) << 1) | ((snapshot & _aPin_bitmask) ? 1 : 0));
+	if (quadMode()) {
+		quadSample((((snapshot & _bPin_bitmask) ? 1 : 0) << 1) | ((snapshot & _aPin_bitmask) ? 1 : 0));
+	} else {
+		applyPinLevels((snapshot & _aPin_bitmask) ? 1 : 0, (snapshot & _bPin_bitmask) ? 1 : 0);
+	}
+	STATS_ISR_END();
+}
+#endif
+
 void ESP_ISR NewEncoder::pinChangeHandler(uint8_t index) {
 	uint8_t newStateVariable;
 
-	newStateVariable = NewEncoder::tablePtr[currentStateVariable][index];
+	STATS_INCREMENT(edges);
+#if NEWENCODER_RATE
+	if (rateUnits == EdgesPerSecond) {
+		updateRate(micros());
+	}
+#endif
+
+	newStateVariable = NEWENCODER_TABLE_READ(tablePtr[currentStateVariable][index]);
 	currentStateVariable = newStateVariable & STATE_MASK;
-	if ((newStateVariable & DELTA_MASK) != 0) {
-		if ((newStateVariable & DELTA_MASK) == INCREMENT_DELTA) {
-			clickUp = true;
-			clickDown = false;
-		} else {
-			clickUp = false;
-			clickDown = true;
+	if ((newStateVariable & (DELTA_MASK | INVALID_TRANSITION)) != 0) {
+		deltaHandler(newStateVariable);
+	}
+}
+
+#if NEWENCODER_EVENT_QUEUE || NEWENCODER_ACCELERATION || NEWENCODER_RATE
+// True if a feature in use needs the time of each detent
+inline bool ESP_ISR NewEncoder::detentTimeNeeded() const {
+	bool needed = false;
+#if NEWENCODER_EVENT_QUEUE
+	needed = needed || (eventQueue != nullptr);
+#endif
+#if NEWENCODER_ACCELERATION
+	needed = needed || (accelerationCurve != nullptr);
+#endif
+#if NEWENCODER_RATE
+	needed = needed || (rateUnits == DetentsPerSecond);
+#endif
+	return needed;
+}
+#endif
+
+void ESP_ISR NewEncoder::deltaHandler(uint8_t updatedStateVariable) {
+	if ((updatedStateVariable & INVALID_TRANSITION) != 0) {
+		COUNT_TRANSITION(invalidTransitions);
+		STATS_INCREMENT(illegalTransitions);
+		return;
+	}
+	STATS_INCREMENT(detents);
+	bool up = (updatedStateVariable & DELTA_MASK) == INCREMENT_DELTA;
+	(void) up;  // Unused if every feature reading it is compiled out
+#if NEWENCODER_DETENT_DELTA
+#if NEWENCODER_ATOMIC_STATE
+	__atomic_fetch_add(&detentDelta, up ? 1UL : 0xFFFFFFFFUL, __ATOMIC_RELAXED);
+#else
+	detentDelta += up ? 1UL : 0xFFFFFFFFUL;  // Wraps instead of overflowing
+#endif
+#endif
+#if NEWENCODER_CLICK_FLAGS
+	clickUp = up;
+	clickDown = !up;
+#endif
+#if NEWENCODER_EVENT_QUEUE || NEWENCODER_ACCELERATION || NEWENCODER_RATE
+	uint32_t detentTime = 0;
+	if (detentTimeNeeded()) {
+		detentTime = micros();
+	}
+#endif
+#if NEWENCODER_ACCELERATION
+	if (accelerationCurve != nullptr) {
+		updateAcceleration(updatedStateVariable, detentTime);
+	}
+#endif
+#if NEWENCODER_RATE
+	if (rateUnits != RateOff) {
+		int8_t direction = up ? 1 : -1;
+		if (direction != rateDirection) {
+			rateDirection = direction;
+			rateSamples = (rateSamples != 0) ? 1 : 0;  // Reversal - restart the filter
+		}
+		if (rateUnits == DetentsPerSecond) {
+			updateRate(detentTime);
 		}
-		updateValue(newStateVariable);
-		if (callBackPtr != nullptr) {
+	}
+#endif
+#if NEWENCODER_ATOMIC_STATE
+	publishState(updatedStateVariable);
+#else
+	updateValue(updatedStateVariable);
+#endif
+#if NEWENCODER_EVENT_QUEUE
+	if (eventQueue != nullptr) {
+		eventQueue->push(detentTime, liveState.currentValue, up ? 1 : -1);
+	}
+#endif
+	if (callBackPtr != nullptr) {
+#if NEWENCODER_DEFERRED
+		if (deferCallback) {
+			markPending();
+		} else
+#endif
+		{
+			STATS_TIMER_START(callbackStart);
 			callBackPtr(this, &liveState, userPointer);
+			STATS_RECORD(callbackHistogram, callbackStart);
+		}
+	}
+	wakeWaiters();
+}
+
+void ESP_ISR NewEncoder::wakeWaiters() {
+#if defined(ESP32)
+	if (waitingTask != nullptr) {
+		TaskHandle_t handle = __atomic_exchange_n(&waitingTask, nullptr, __ATOMIC_ACQ_REL);
+		if (handle != nullptr) {
+			BaseType_t higherPriorityTaskWoken = pdFALSE;
+			vTaskNotifyGiveIndexedFromISR(handle, NEWENCODER_NOTIFY_INDEX, &higherPriorityTaskWoken);
+			if (higherPriorityTaskWoken == pdTRUE) {
+				portYIELD_FROM_ISR();
+			}
+		}
+	}
+#elif defined(NEWENCODER_HOST)
+	if (waiterArmed && __atomic_exchange_n(&waiterArmed, false, __ATOMIC_ACQ_REL)) {
+		changeNotification.give();
+	}
+#endif
+#if NEWENCODER_COROUTINES
+	if (awaitingCoroutine != nullptr) {
+		markPending();
+	}
+#endif
+}
+
+#if NEWENCODER_DEFERRED
+void ESP_ISR NewEncoder::markPending() {
+	int8_t slot = deferredSlot;  // Read once. It may be released from another core at any time.
+	if (slot < 0) {
+		return;
+	}
+#if NEWENCODER_ATOMIC_STATE
+	__atomic_fetch_or(&deferredPending, 1UL << slot, __ATOMIC_RELEASE);
+#else
+	deferredPending |= 1UL << slot;
+#endif
+#if defined(ESP32)
+	TaskHandle_t handle = serviceTaskHandle;
+	if (handle != nullptr) {
+		BaseType_t higherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(handle, &higherPriorityTaskWoken);
+		if (higherPriorityTaskWoken == pdTRUE) {
+			portYIELD_FROM_ISR();
+		}
+	}
+#endif
+}
+#endif
+
+#if NEWENCODER_RATE
+// Exponential moving average of the event interval. Integer add / subtract / shift only.
+void ESP_ISR NewEncoder::updateRate(uint32_t eventTime) {
+	uint32_t interval = eventTime - lastRateTime;
+	lastRateTime = eventTime;
+	if ((rateSamples == 0) || (interval > rateTimeoutMicros)) {
+		rateSamples = 1;  // First event after a stop only sets the time reference
+		return;
+	}
+	uint32_t sample = interval << RATE_FRACTION_BITS;
+	if (rateSamples == 1) {
+		filteredPeriod = sample;
+		rateSamples = 2;
+	} else {
+		filteredPeriod = filteredPeriod - (filteredPeriod >> RATE_FILTER_SHIFT) + (sample >> RATE_FILTER_SHIFT);
+	}
+}
+#endif
+
+#if NEWENCODER_ACCELERATION
+void ESP_ISR NewEncoder::updateAcceleration(uint8_t updatedStateVariable, uint32_t detentTime) {
+	uint8_t delta = updatedStateVariable & DELTA_MASK;
+	uint32_t interval = detentTime - lastDetentTime;
+	uint32_t maxInterval = accelerationCurve[accelerationSteps - 1].maxIntervalMicros;
+	uint32_t detentMillis = millis();
+	uint16_t step = 1;
+
+	// Only consecutive detents in the same direction accelerate. The first detent (lastDetentDelta 0), a reversal, and
+	// a detent slower than the last point are 1x steps. Integer compare only, at most accelerationSteps iterations.
+	// interval wraps with micros() every 71 minutes, so after a long idle it may look short. The idle is also checked
+	// on the millis() clock, with 2 ms of slack because millis() may trail micros() or skip a tick (AVR).
+	if ((delta == lastDetentDelta) && (interval <= maxInterval) && ((detentMillis - lastDetentMillis) <= (maxInterval / 1000) + 2)) {
+		for (uint8_t i = 0; i < accelerationSteps; i++) {
+			if (interval <= accelerationCurve[i].maxIntervalMicros) {
+				step = accelerationCurve[i].step;
+				break;
+			}
 		}
 	}
+	lastDetentDelta = delta;
+	lastDetentTime = detentTime;
+	lastDetentMillis = detentMillis;
+	detentStep = step;
+}
+#endif
+
+#if NEWENCODER_ATOMIC_STATE
+// Apply updateValue() to the published value and publish the result with one compare-and-swap. If another core
+// changed the value in between (getAndSet(), newSettings(), ...), updateValue() is repeated on the new value.
+void ESP_ISR NewEncoder::publishState(uint8_t updatedStateVariable) {
+	PackedState expected = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+	PackedState desired;
+	do {
+		liveState.currentValue = unpackValue(expected);
+		updateValue(updatedStateVariable);
+		desired = packState(liveState.currentValue, liveState.currentClick, true);
+	} while (!__atomic_compare_exchange_n(&publishedState, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+// Replace the published value, keeping the click and changed flag. Returns the previous packed state.
+uint32_t NewEncoder::exchangeValue(EncoderValue val) {
+	PackedState expected = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(&publishedState, &expected,
+			(expected & ATOMIC_FLAG_MASK) | packValue(val), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	}
+	return expected;
 }
+#endif
 
 void ESP_ISR NewEncoder::updateValue(uint8_t updatedStateVariable) {
 	if ((updatedStateVariable & DELTA_MASK) == INCREMENT_DELTA) {
 		liveState.currentClick = UpClick;
 		if (liveState.currentValue < _maxValue) {
-			liveState.currentValue++;
+			if (detentStep == 1) {
+				liveState.currentValue++;
+			} else if (static_cast<ValueTraits::Unsigned>(static_cast<ValueTraits::Unsigned>(_maxValue)
+					- static_cast<ValueTraits::Unsigned>(liveState.currentValue)) > detentStep) {
+				liveState.currentValue += detentStep;
+			} else {
+				liveState.currentValue = _maxValue;
+			}
 		}
 	} else if ((updatedStateVariable & DELTA_MASK) == DECREMENT_DELTA) {
 		liveState.currentClick = DownClick;
 		if (liveState.currentValue > _minValue) {
-			liveState.currentValue--;
+			if (detentStep == 1) {
+				liveState.currentValue--;
+			} else if (static_cast<ValueTraits::Unsigned>(static_cast<ValueTraits::Unsigned>(liveState.currentValue)
+					- static_cast<ValueTraits::Unsigned>(_minValue)) > detentStep) {
+				liveState.currentValue -= detentStep;
+			} else {
+				liveState.currentValue = _minValue;
+			}
 		}
 	}
 	stateChanged = true;
@@ -23,6 +23,7 @@
 #define DELTA_MASK 0b00011000
 #define INCREMENT_DELTA 0b00001000
 #define DECREMENT_DELTA 0b00010000
+#define INVALID_TRANSITION 0b00100000
 
 #include <Arduino.h>
 #include "utility/interrupt_pins.h"
@@ -30,35 +31,547 @@
 
 #define FULL_PULSE 0
 #define HALF_PULSE 1
+#define QUAD_X4 2
+#define QUAD_X2 3
+
+#define A_PIN_FALLING 0b00
+#define A_PIN_RISING 0b01
+#define B_PIN_FALLING 0b10
+#define B_PIN_RISING  0b11
+
+// States for "one pulse per detent" type encoder
+#define START_STATE 0b011
+#define CW_STATE_1 0b010
+#define CW_STATE_2 0b000
+#define CW_STATE_3 0b001
+#define CCW_STATE_1 0b101
+#define CCW_STATE_2 0b100
+#define CCW_STATE_3 0b110
+
+// States for "one pulse per two detents" type encoder
+#define DETENT_0 0b000
+#define DETENT_1 0b111
+#define DEBOUNCE_0 0b010
+#define DEBOUNCE_1 0b001
+#define DEBOUNCE_2 0b101
+#define DEBOUNCE_3 0b110
+
+#if defined(__AVR__)
+#define NEWENCODER_MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define NEWENCODER_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+// With NEWENCODER_ATOMIC_STATE set to 1, the value / click / changed flag are published as one 32-bit word
+// that is read and updated with atomic compare-and-swap instead of noInterrupts() / interrupts(). This is
+// required when the encoder's interrupts may run on a different core than the code calling getState(), etc.
+// Requires the default int16_t value: ESP32 and RP2040 have no lock-free 64-bit compare-and-swap for a wider one.
+// Must be set the same way for the library and the sketch (i.e. as a build flag).
+#ifndef NEWENCODER_ATOMIC_STATE
+#if defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define NEWENCODER_ATOMIC_STATE 1
+#else
+#define NEWENCODER_ATOMIC_STATE 0
+#endif
+#endif
+
+// Type of the encoder's value, minValue, and maxValue: int16_t (default), int32_t, or int64_t.
+// Must be set the same way for the library and the sketch (i.e. as a build flag).
+#ifndef NEWENCODER_VALUE_TYPE
+#define NEWENCODER_VALUE_TYPE int16_t
+#endif
+
+// With NEWENCODER_STATS set to 1, each encoder counts its edges, no-op edges, illegal transitions, and detents and
+// keeps histograms of ISR and callback duration. See getStats(). Must be set the same way for the library and the sketch.
+#ifndef NEWENCODER_STATS
+#define NEWENCODER_STATS 0
+#endif
+
+#if NEWENCODER_STATS
+#ifndef NEWENCODER_STATS_BUCKETS
+#define NEWENCODER_STATS_BUCKETS 16
+#endif
+
+// Time base of the duration histograms: CPU cycles where a cycle counter is available, microseconds otherwise
+#ifndef NEWENCODER_STATS_TIMER
+#if defined(NEWENCODER_HOST)
+#define NEWENCODER_STATS_TIMER() static_cast<uint32_t>(HostHal::cycleCount())
+#elif defined(ESP8266) || defined(ESP32)
+#define NEWENCODER_STATS_TIMER() ESP.getCycleCount()
+#elif defined(ARM_DWT_CYCCNT)
+#define NEWENCODER_STATS_TIMER() ARM_DWT_CYCCNT
+#else
+#define NEWENCODER_STATS_TIMER() micros()
+#endif
+#endif
+#endif
+
+// Time base of the glitch filter (see setGlitchFilter()) and its ticks per microsecond. A free-running cycle counter
+// where one is available, micros() otherwise.
+#ifndef NEWENCODER_FILTER_TIMER
+#if defined(ESP8266) || defined(ESP32)
+#define NEWENCODER_FILTER_TIMER() ESP.getCycleCount()
+#define NEWENCODER_FILTER_TICKS_PER_MICRO ESP.getCpuFreqMHz()
+#elif defined(ARM_DWT_CYCCNT) && defined(F_CPU)
+#define NEWENCODER_FILTER_TIMER() ARM_DWT_CYCCNT
+#define NEWENCODER_FILTER_TICKS_PER_MICRO (F_CPU / 1000000UL)
+#else
+#define NEWENCODER_FILTER_TIMER() micros()
+#define NEWENCODER_FILTER_TICKS_PER_MICRO 1
+#endif
+#endif
+
+// With NEWENCODER_COMPACT set to 1, each NewEncoder uses less SRAM: its flags are packed into bit-fields, the optional
+// features below default to off, and, on AVR, the transition tables stay in flash (PROGMEM) and are read with
+// pgm_read_byte() in the ISR. Tables passed to configure() must then be PROGMEM too. Must be set the same way for the
+// library and the sketch.
+#ifndef NEWENCODER_COMPACT
+#define NEWENCODER_COMPACT 0
+#endif
+
+// With NEWENCODER_CLICK_FLAGS set to 0, the deprecated upClick() / downClick() and their flags are removed.
+#ifndef NEWENCODER_CLICK_FLAGS
+#define NEWENCODER_CLICK_FLAGS 1
+#endif
+
+// Optional features. Each is on by default and off by default with NEWENCODER_COMPACT, and may be set to 0 or 1 on its
+// own. Setting one to 0 removes its functions, its per-encoder state, and its code in the ISR. Must be set the same way
+// for the library and the sketch.
+
+// beginPolling(), setPollIntervals(), poll(), pollAll()
+#ifndef NEWENCODER_POLLING
+#define NEWENCODER_POLLING (!NEWENCODER_COMPACT)
+#endif
+
+// setStormProtection(), serviceStorms(), stormActive(), getStorms(), getStormMillis(). Requires NEWENCODER_POLLING.
+#ifndef NEWENCODER_STORM_PROTECTION
+#define NEWENCODER_STORM_PROTECTION NEWENCODER_POLLING
+#endif
+#if NEWENCODER_STORM_PROTECTION && !NEWENCODER_POLLING
+#error "NEWENCODER_STORM_PROTECTION requires NEWENCODER_POLLING"
+#endif
+
+// setGlitchFilter(), getFilteredEdges()
+#ifndef NEWENCODER_GLITCH_FILTER
+#define NEWENCODER_GLITCH_FILTER (!NEWENCODER_COMPACT)
+#endif
+
+// setAcceleration(). Without it, every detent changes the value by 1.
+#ifndef NEWENCODER_ACCELERATION
+#define NEWENCODER_ACCELERATION (!NEWENCODER_COMPACT)
+#endif
+
+// setRateUnits(), getRate()
+#ifndef NEWENCODER_RATE
+#define NEWENCODER_RATE (!NEWENCODER_COMPACT)
+#endif
+
+// attachEventQueue(), readEvents(), getEventOverflows()
+#ifndef NEWENCODER_EVENT_QUEUE
+#define NEWENCODER_EVENT_QUEUE (!NEWENCODER_COMPACT)
+#endif
+
+// attachTrace()
+#ifndef NEWENCODER_TRACE
+#define NEWENCODER_TRACE (!NEWENCODER_COMPACT)
+#endif
+
+// attachDeferredCallback(), service(), startServiceTask(), and the nextEvent() coroutine awaitable
+#ifndef NEWENCODER_DEFERRED
+#define NEWENCODER_DEFERRED (!NEWENCODER_COMPACT)
+#endif
+
+// readAndClearDelta()
+#ifndef NEWENCODER_DETENT_DELTA
+#define NEWENCODER_DETENT_DELTA (!NEWENCODER_COMPACT)
+#endif
+
+// getInvalidTransitions(), getInferredTransitions()
+#ifndef NEWENCODER_TRANSITION_COUNTS
+#define NEWENCODER_TRANSITION_COUNTS (!NEWENCODER_COMPACT)
+#endif
+
+// Encoders may share an interrupt with each other (and an encoder's two pins may share one). Set to 0, each interrupt
+// serves one pin of one encoder through a static table, and the encoders hold no chain links. Only applies where the
+// library attaches its own trampolines (not ESP8266 / ESP32 / STM32).
+#ifndef NEWENCODER_SHARED_INTERRUPTS
+#define NEWENCODER_SHARED_INTERRUPTS (!NEWENCODER_COMPACT)
+#endif
+
+// Placement of, and ISR access to, the transition tables. The host build uses the flash branch with plain reads.
+#if NEWENCODER_COMPACT && (defined(__AVR__) || defined(NEWENCODER_HOST))
+#define NEWENCODER_TABLE_ATTR PROGMEM
+#define NEWENCODER_TABLE_READ(entry) pgm_read_byte(&(entry))
+#else
+#define NEWENCODER_TABLE_ATTR
+#define NEWENCODER_TABLE_READ(entry) (entry)
+#endif
+
+// nextEvent() awaitable for C++20 coroutines. On by default when the compiler supports them. Requires NEWENCODER_DEFERRED.
+#ifndef NEWENCODER_COROUTINES
+#if NEWENCODER_DEFERRED && defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define NEWENCODER_COROUTINES 1
+#endif
+#endif
+#endif
+#ifndef NEWENCODER_COROUTINES
+#define NEWENCODER_COROUTINES 0
+#endif
+#if NEWENCODER_COROUTINES && !NEWENCODER_DEFERRED
+#error "NEWENCODER_COROUTINES requires NEWENCODER_DEFERRED"
+#endif
+
+#if NEWENCODER_COROUTINES
+#include <coroutine>
+#endif
+
+// Task notification index waitForChange() sleeps on (ESP32). The last index if FreeRTOS is built with more than one
+// (configTASK_NOTIFICATION_ARRAY_ENTRIES), so notifications the sketch sends to the waiting task are left alone.
+// Otherwise index 0, which the waiting task must then not use for anything else.
+#if defined(ESP32) && !defined(NEWENCODER_NOTIFY_INDEX)
+#if defined(configTASK_NOTIFICATION_ARRAY_ENTRIES) && (configTASK_NOTIFICATION_ARRAY_ENTRIES > 1)
+#define NEWENCODER_NOTIFY_INDEX (configTASK_NOTIFICATION_ARRAY_ENTRIES - 1)
+#else
+#define NEWENCODER_NOTIFY_INDEX 0
+#endif
+#endif
+
+// Maximum number of encoders with a deferred callback or an awaiting coroutine (see attachDeferredCallback(),
+// nextEvent()). 32 at most.
+#ifndef NEWENCODER_MAX_DEFERRED
+#define NEWENCODER_MAX_DEFERRED 8
+#endif
+
+// Widest object (in bytes) the processor reads or writes with a single access. Wider values need a critical section.
+#if defined(__AVR__)
+#define NEWENCODER_ATOMIC_ACCESS_BYTES 1
+#else
+#define NEWENCODER_ATOMIC_ACCESS_BYTES 4
+#endif
+
+// Helper types for each value width. Unsigned: same width as the value, for overflow-free distances.
+template<uint8_t SIZE> struct NewEncoderValueTraits;
+
+template<> struct NewEncoderValueTraits<2> {
+	using Unsigned = uint16_t;
+};
+
+template<> struct NewEncoderValueTraits<4> {
+	using Unsigned = uint32_t;
+};
+
+template<> struct NewEncoderValueTraits<8> {
+	using Unsigned = uint64_t;
+};
 
 class NewEncoder {
 
 public:
+	using EncoderValue = NEWENCODER_VALUE_TYPE;
+	using ValueTraits = NewEncoderValueTraits<sizeof(EncoderValue)>;
+#if NEWENCODER_ATOMIC_STATE
+	static_assert(sizeof(EncoderValue) == 2, "NEWENCODER_ATOMIC_STATE requires an int16_t NEWENCODER_VALUE_TYPE");
+#endif
+
 	enum EncoderClick {
 		NoClick, DownClick, UpClick
 	};
 
+#if NEWENCODER_RATE
+	enum RateUnits {
+		RateOff, DetentsPerSecond, EdgesPerSecond
+	};
+#endif
+
 	struct EncoderState {
-		int16_t currentValue = 0;
+		EncoderValue currentValue = 0;
 		EncoderClick currentClick = NoClick;
 	};
 
+#if NEWENCODER_EVENT_QUEUE
+	struct EncoderEvent {
+		uint32_t timestamp;  // micros() when the detent completed
+		EncoderValue value;       // currentValue after the detent was applied
+		int8_t delta;        // +1 for UpClick, -1 for DownClick
+	};
+#endif
+
+#if NEWENCODER_ACCELERATION
+	// One point of an acceleration curve. Detents arriving no more than maxIntervalMicros after the previous one
+	// (in the same direction) change the value by step instead of 1.
+	struct AccelerationStep {
+		uint32_t maxIntervalMicros;
+		uint16_t step;
+	};
+#endif
+
+#if NEWENCODER_STATS
+	struct EncoderStats {
+		uint32_t edges = 0;               // Pin changes run through the transition table
+		uint32_t noOpEdges = 0;           // Interrupts where the pin level had not changed (e.g. bounce shorter than the ISR)
+		uint32_t filteredEdges = 0;       // Pin changes dropped by the glitch filter
+		uint32_t illegalTransitions = 0;  // Invalid transitions and illegal states that were reset
+		uint32_t detents = 0;             // Detents (counts in the QUAD modes) applied to the value
+		uint32_t isrHistogram[NEWENCODER_STATS_BUCKETS] = { };       // ISR duration, see README
+		uint32_t callbackHistogram[NEWENCODER_STATS_BUCKETS] = { };  // Callback duration
+	};
+#endif
+
+#if NEWENCODER_EVENT_QUEUE
+	// Single-producer (ISR) / single-consumer ring of EncoderEvents. Create storage for it with EventBuffer<SIZE>.
+	class EventQueue {
+	public:
+		uint8_t available() const;
+		uint8_t read(EncoderEvent *buffer, uint8_t maxEvents);
+		uint32_t overflows() const;
+
+	protected:
+		EventQueue(EncoderEvent *storage, uint8_t sizeMask) :
+				buffer(storage), mask(sizeMask) {
+		}
+
+	private:
+		friend class NewEncoder;
+		void push(uint32_t timestamp, EncoderValue value, int8_t delta);
+
+		EncoderEvent *const buffer;
+		const uint8_t mask;
+		volatile uint8_t head = 0;
+		volatile uint8_t tail = 0;
+		volatile uint32_t overflowCount = 0;
+	};
+
+	template<uint8_t SIZE>
+	class EventBuffer: public EventQueue {
+		static_assert((SIZE >= 2) && (SIZE <= 128) && ((SIZE & (SIZE - 1)) == 0), "EventBuffer SIZE must be a power of 2 between 2 and 128");
+	public:
+		EventBuffer() :
+				EventQueue(storage, SIZE - 1) {
+		}
+
+	private:
+		EncoderEvent storage[SIZE];
+	};
+#endif
+
+#if NEWENCODER_TRACE
+	// Flight recorder of the raw pin levels seen by the encoder's ISRs (see attachTrace()). Create storage for it with
+	// TraceBuffer<SIZE>. Each record is one 32-bit word: the new B/A levels in bits 1..0 and the time since the previous
+	// record in bits 31..2, in NEWENCODER_FILTER_TIMER() ticks (saturated). When full, the oldest records are overwritten.
+	class TraceRing {
+	public:
+		uint32_t recorded() const;
+		size_t dump(Print &out);
+		void clear();
+
+		static constexpr uint32_t DUMP_MAGIC = 0x5254454EUL;  // "NETR" as written by dump() (little-endian)
+		static constexpr uint8_t DUMP_VERSION = 1;
+		static constexpr uint8_t DUMP_HEADER_BYTES = 20;
+		static constexpr uint32_t LEVELS_MASK = 0b11;
+		static constexpr uint8_t TIME_SHIFT = 2;
+		static constexpr uint32_t MAX_TICKS = 0xFFFFFFFFUL >> TIME_SHIFT;
+
+	protected:
+		TraceRing(uint32_t *storage, uint16_t sizeMask) :
+				buffer(storage), mask(sizeMask) {
+		}
+
+	private:
+		friend class NewEncoder;
+		void start(uint8_t levels);
+		void push(uint8_t pinMask, uint8_t levels);
+
+		uint32_t *const buffer;
+		const uint16_t mask;
+		volatile uint32_t written = 0;
+		volatile uint32_t lastTime = 0;
+		volatile uint8_t lastLevels = 0;
+		volatile bool capturing = false;
+	};
+
+	template<uint16_t SIZE>
+	class TraceBuffer: public TraceRing {
+		static_assert((SIZE >= 2) && (SIZE <= 32768) && ((SIZE & (SIZE - 1)) == 0), "TraceBuffer SIZE must be a power of 2 between 2 and 32768");
+	public:
+		TraceBuffer() :
+				TraceRing(storage, SIZE - 1) {
+		}
+
+	private:
+		uint32_t storage[SIZE];
+	};
+#endif
+
+	// Each table row is a state, indexed by A_PIN_FALLING, A_PIN_RISING, B_PIN_FALLING, B_PIN_RISING.
+	// Each entry is the next state (STATE_MASK) plus the INCREMENT_DELTA / DECREMENT_DELTA bits.
+	using encoderStateTransition = uint8_t[4];
+
+	// Transition table for "one pulse per detent" type encoder
+	static constexpr encoderStateTransition fullPulseTransitionTable[8] NEWENCODER_TABLE_ATTR = {
+			{ CW_STATE_2, CW_STATE_3, CW_STATE_2, CW_STATE_1 }, // cwState2 = 0b000
+			{ CW_STATE_2, CW_STATE_3, CW_STATE_3, START_STATE | INCREMENT_DELTA }, // cwState3 = 0b001
+			{ CW_STATE_1, START_STATE, CW_STATE_2, CW_STATE_1 },  // cwState1 = 0b010
+			{ CW_STATE_1, START_STATE, CCW_STATE_1, START_STATE }, // startState = 0b011
+			{ CCW_STATE_2, CCW_STATE_1, CCW_STATE_2, CCW_STATE_3 }, // ccwState2 = 0b100
+			{ CCW_STATE_2, CCW_STATE_1, CCW_STATE_1, START_STATE }, // ccwState1 = 0b101
+			{ CCW_STATE_3, START_STATE | DECREMENT_DELTA, CCW_STATE_2, CCW_STATE_3 }, // ccwState3 = 0b110
+			{ START_STATE | INVALID_TRANSITION, START_STATE | INVALID_TRANSITION, START_STATE | INVALID_TRANSITION,
+					START_STATE | INVALID_TRANSITION } // 0b111 illegal state should never be in it
+	};
+
+	// Transition table for "one pulse per two detents" type encoder
+	static constexpr encoderStateTransition halfPulseTransitionTable[8] NEWENCODER_TABLE_ATTR = {
+			{ DETENT_0, DEBOUNCE_1, DETENT_0, DEBOUNCE_0 },  // DETENT_0 0b000
+			{ DETENT_0, DEBOUNCE_1, DEBOUNCE_1, DETENT_1 | INCREMENT_DELTA }, // DEBOUNCE_1 0b001
+			{ DEBOUNCE_0, DETENT_1 | DECREMENT_DELTA, DETENT_0, DEBOUNCE_0 },  // DEBOUNCE_0 0b010
+			{ DETENT_1 | INVALID_TRANSITION, DETENT_1 | INVALID_TRANSITION, DETENT_1 | INVALID_TRANSITION,
+					DETENT_1 | INVALID_TRANSITION },  // 0b011 - illegal state should never be in it
+			{ DETENT_0 | INVALID_TRANSITION, DETENT_0 | INVALID_TRANSITION, DETENT_0 | INVALID_TRANSITION,
+					DETENT_0 | INVALID_TRANSITION },  // 0b100 - illegal state should never be in it
+			{ DETENT_0 | DECREMENT_DELTA, DEBOUNCE_2, DEBOUNCE_2, DETENT_1 }, // DEBOUNCE_2 0b101
+			{ DEBOUNCE_3, DETENT_1, DETENT_0 | INCREMENT_DELTA, DEBOUNCE_3 },  // DEBOUNCE_3 0b110
+			{ DEBOUNCE_3, DETENT_1, DEBOUNCE_2, DETENT_1 }  // DETENT_1 0b111
+	};
+
+	// The QUAD tables are indexed differently: the ISR reads both pins, each row is the previous B/A levels
+	// (B << 1 | A) and each column is the new B/A levels. A change of both levels at once is an invalid transition.
+
+	// Transition table for raw quadrature counting - one count per edge
+	static constexpr encoderStateTransition quadX4TransitionTable[8] NEWENCODER_TABLE_ATTR = {
+			{ 0b00, 0b01 | INCREMENT_DELTA, 0b10 | DECREMENT_DELTA, 0b11 | INVALID_TRANSITION },  // 0b00
+			{ 0b00 | DECREMENT_DELTA, 0b01, 0b10 | INVALID_TRANSITION, 0b11 | INCREMENT_DELTA },  // 0b01
+			{ 0b00 | INCREMENT_DELTA, 0b01 | INVALID_TRANSITION, 0b10, 0b11 | DECREMENT_DELTA },  // 0b10
+			{ 0b00 | INVALID_TRANSITION, 0b01 | DECREMENT_DELTA, 0b10 | INCREMENT_DELTA, 0b11 },  // 0b11
+			{ 0b00, 0b01, 0b10, 0b11 },  // 0b100 - 0b111 unused, resynchronize
+			{ 0b00, 0b01, 0b10, 0b11 },
+			{ 0b00, 0b01, 0b10, 0b11 },
+			{ 0b00, 0b01, 0b10, 0b11 }
+	};
+
+	// Transition table for raw quadrature counting - one count per A pin edge
+	static constexpr encoderStateTransition quadX2TransitionTable[8] NEWENCODER_TABLE_ATTR = {
+			{ 0b00, 0b01 | INCREMENT_DELTA, 0b10, 0b11 | INVALID_TRANSITION },  // 0b00
+			{ 0b00 | DECREMENT_DELTA, 0b01, 0b10 | INVALID_TRANSITION, 0b11 },  // 0b01
+			{ 0b00, 0b01 | INVALID_TRANSITION, 0b10, 0b11 | DECREMENT_DELTA },  // 0b10
+			{ 0b00 | INVALID_TRANSITION, 0b01, 0b10 | INCREMENT_DELTA, 0b11 },  // 0b11
+			{ 0b00, 0b01, 0b10, 0b11 },  // 0b100 - 0b111 unused, resynchronize
+			{ 0b00, 0b01, 0b10, 0b11 },
+			{ 0b00, 0b01, 0b10, 0b11 },
+			{ 0b00, 0b01, 0b10, 0b11 }
+	};
+
+#if NEWENCODER_COROUTINES
+	// Result of nextEvent(). co_await yields the new state, as getState() returns it.
+	class ChangeAwaiter {
+	public:
+		explicit ChangeAwaiter(NewEncoder &enc) :
+				encoder(enc) {
+		}
+		bool await_ready() {
+			ready = encoder.getState(state);
+			return ready;
+		}
+		bool await_suspend(std::coroutine_handle<> handle) {
+			return encoder.suspendUntilChange(handle.address());
+		}
+		EncoderState await_resume() {
+			if (!ready) {
+				encoder.getState(state);
+				encoder.finishAwait();
+			}
+			return state;
+		}
+
+	private:
+		NewEncoder &encoder;
+		EncoderState state;
+		bool ready = false;
+	};
+#endif
+
+	static constexpr uint32_t WAIT_FOREVER = 0xFFFFFFFFUL;
+
 private:
 	using EncoderCallBack = void(*)(NewEncoder*, const volatile EncoderState*, void*);
-	using encoderStateTransition = uint8_t[4];
 
 public:
-	NewEncoder(uint8_t aPin, uint8_t bPin, int16_t minValue, int16_t maxValue, int16_t initalValue, uint8_t type = FULL_PULSE);
+	NewEncoder(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue, EncoderValue initalValue, uint8_t type = FULL_PULSE);
+	NewEncoder(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue, EncoderValue initalValue,
+			const encoderStateTransition (&table)[8]);
 	NewEncoder();
 	virtual ~NewEncoder();
 	virtual bool begin();
-	virtual void configure(uint8_t aPin, uint8_t bPin, int16_t minValue, int16_t maxValue, int16_t initalValue, uint8_t type = FULL_PULSE);
+	virtual void configure(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue, EncoderValue initalValue, uint8_t type = FULL_PULSE);
+	void configure(uint8_t aPin, uint8_t bPin, EncoderValue minValue, EncoderValue maxValue, EncoderValue initalValue,
+			const encoderStateTransition (&table)[8]);
 	virtual void end();
 	bool enabled() const;
+	// For interrupts attached outside NewEncoder, e.g. by NewEncoderT. claimInterrupt() returns false if an encoder or
+	// an earlier claim already has interrupt intNumber.
+	static bool claimInterrupt(uint8_t intNumber);
+	static void releaseInterrupt(uint8_t intNumber);
+#if NEWENCODER_POLLING
+	bool beginPolling();
+	void setPollIntervals(uint32_t fastMicros, uint32_t slowMicros, uint32_t idleMicros = 100000UL);
+	uint32_t poll();
+	static uint32_t pollAll();
+#endif
 	void attachCallback(EncoderCallBack cback, void *uPtr = nullptr);
+#if NEWENCODER_DEFERRED
+	bool attachDeferredCallback(EncoderCallBack cback, void *uPtr = nullptr);
+	static uint8_t service();
+#if defined(ESP32)
+	static bool startServiceTask(uint32_t stackDepth = 2048, UBaseType_t priority = 1, BaseType_t coreId = tskNO_AFFINITY);
+#endif
+#endif
+#if NEWENCODER_EVENT_QUEUE
+	void attachEventQueue(EventQueue *queue);
+	uint8_t readEvents(EncoderEvent *buffer, uint8_t maxEvents);
+	uint32_t getEventOverflows() const;
+#endif
+#if NEWENCODER_TRACE
+	void attachTrace(TraceRing *ring);
+#endif
+#if NEWENCODER_TRANSITION_COUNTS
+	uint32_t getInvalidTransitions() const;
+	uint32_t getInferredTransitions() const;
+#endif
+#if NEWENCODER_GLITCH_FILTER
+	void setGlitchFilter(uint32_t minEdgeMicros);
+	uint32_t getFilteredEdges() const;
+#endif
+	void setBothPinSampling(bool enable);
+#if NEWENCODER_STORM_PROTECTION
+	void setStormProtection(uint16_t maxEdges, uint32_t windowMicros = 10000UL, uint32_t quietMicros = 100000UL);
+	static uint32_t serviceStorms();
+	bool stormActive() const;
+	uint32_t getStorms() const;
+	uint32_t getStormMillis() const;
+#endif
+#if NEWENCODER_RATE
+	void setRateUnits(RateUnits units, uint32_t timeoutMicros = 1000000UL);
+	float getRate();
+#endif
+#if NEWENCODER_STATS
+	void getStats(EncoderStats &stats);
+	void resetStats();
+#endif
+#if NEWENCODER_ACCELERATION
+	void setAcceleration(const AccelerationStep *curve, uint8_t numSteps);
+	static const AccelerationStep defaultAccelerationCurve[];
+	static const uint8_t defaultAccelerationCurveSteps;
+#endif
 	bool getState(EncoderState &state);
-	bool getAndSet(int16_t val, EncoderState &Oldstate, EncoderState &Newstate);
-	bool newSettings(int16_t newMin, int16_t newMax, int16_t newCurrent, EncoderState &state);
+	bool waitForChange(EncoderState &state, uint32_t timeoutMillis = WAIT_FOREVER);
+#if NEWENCODER_COROUTINES
+	ChangeAwaiter nextEvent();
+#endif
+	bool getAndSet(EncoderValue val, EncoderState &Oldstate, EncoderState &Newstate);
+#if NEWENCODER_DETENT_DELTA
+	int32_t readAndClearDelta();
+#endif
+	bool newSettings(EncoderValue newMin, EncoderValue newMax, EncoderValue newCurrent, EncoderState &state);
 
 	NewEncoder(const NewEncoder&) = delete; // delete copy constructor. no copying allowed
 	NewEncoder& operator=(const NewEncoder&) = delete; // delete operator=(). no assignment allowed
@@ -69,93 +582,381 @@ protected:
 	// Caution - this function is called in interrupt context.
 	virtual void updateValue(uint8_t updatedState);
 
-	volatile int16_t _minValue = 0, _maxValue = 0;
+	volatile EncoderValue _minValue = 0, _maxValue = 0;
+#if NEWENCODER_ACCELERATION
+	volatile uint16_t detentStep = 1;  // Amount the current detent should change the value by (acceleration)
+#else
+	static constexpr uint16_t detentStep = 1;
+#endif
 	volatile EncoderState liveState;
 	volatile bool stateChanged;
 	EncoderState localState;
 	bool configured = false;
 
 private:
+	friend class NewEncoderPort;
+	friend class NewEncoderGroup;
+	friend class NewEncoderStore;
+	bool validConfiguration() const;
+	bool interruptsAvailable() const;
+	bool sharesInterrupt(const NewEncoder &other) const;
+	bool startInterrupts();
+	bool attachPinInterrupts();
+	void detachPinInterrupts();
+#if !NEWENCODER_ATOMIC_STATE
+	bool latchState();
+#endif
+	void initPins();
+	void readPinState();
+	EncoderValue peekValue() const;
+	bool quadMode() const;
 	void pinChangeHandler(uint8_t index);
+	void deltaHandler(uint8_t updatedStateVariable);
+#if NEWENCODER_EVENT_QUEUE || NEWENCODER_ACCELERATION || NEWENCODER_RATE
+	bool detentTimeNeeded() const;
+#endif
+#if NEWENCODER_ACCELERATION
+	void updateAcceleration(uint8_t updatedStateVariable, uint32_t detentTime);
+#endif
+#if NEWENCODER_RATE
+	void updateRate(uint32_t eventTime);
+#endif
+#if NEWENCODER_DEFERRED
+	void markPending();
+	void dispatchDeferred();
+	bool acquireDeferredSlot();
+	void releaseDeferredSlot();
+#endif
+	bool changePending() const;
+	void wakeWaiters();
+#if NEWENCODER_COROUTINES
+	bool suspendUntilChange(void *coroutine);
+	void finishAwait();
+#endif
 	void aPinChange();
 	void bPinChange();
+	void quadPinChange();
+	void aPinSync();
+	void bPinSync();
+	void syncPins();
+	void applyPinLevels(uint8_t newAPinValue, uint8_t newBPinValue);
+	void quadSample(uint8_t newLevels);
+#if NEWENCODER_GLITCH_FILTER
+	bool filterRejects(volatile uint32_t &lastEdgeTime, uint8_t pendingBit);
+	void settleFilteredPins(uint8_t settleMask);
+#endif
+#ifdef DIRECT_PORT_READ
+	void portSample(IO_REG_TYPE snapshot);
+#endif
+#if NEWENCODER_POLLING
+	void unlinkFrom(NewEncoder *&listHead);
+	bool pollPins();
+	uint32_t pollIfDue();
+#endif
+#if NEWENCODER_STORM_PROTECTION
+	bool stormRejects();
+	uint32_t serviceStorm();
+	void leaveStorm();
+#endif
+	static constexpr bool valueNeedsCriticalSection = sizeof(EncoderValue) > NEWENCODER_ATOMIC_ACCESS_BYTES;
+#if NEWENCODER_COMPACT
+	void initPackedState();
+	bool active :1;
+	bool portDriven :1;
+#if NEWENCODER_POLLING
+	bool pollDriven :1;
+#endif
+	bool bothPinSampling :1;
+#else
 	bool active = false;
+	bool portDriven = false;
+#if NEWENCODER_POLLING
+	bool pollDriven = false;
+#endif
+	bool bothPinSampling = false;  // FULL_PULSE / HALF_PULSE: each pin's ISR reads both pins. Selected by startInterrupts().
+#endif
+
+#if NEWENCODER_POLLING
+	// Polling backend (beginPolling()). Samples every pollFastMicros while the pins are changing, every
+	// pollSlowMicros once they have been still for pollIdleMicros.
+	uint32_t pollFastMicros = 250;
+	uint32_t pollSlowMicros = 2000;
+	uint32_t pollIdleMicros = 100000UL;
+	volatile uint32_t lastPollTime = 0;
+	volatile uint32_t lastPollChange = 0;
+	volatile bool pollMoving = false;
+	NewEncoder *nextPolled = nullptr;  // In polledEncoders or stormEncoders
+	static NewEncoder *polledEncoders;  // Singly-linked list of the encoders serviced by pollAll()
+#endif
+
+#if NEWENCODER_STORM_PROTECTION
+	// Interrupt-storm protection (setStormProtection()). More than stormMaxEdges pin interrupts in one window of
+	// stormWindowMicros detach the interrupts and link the encoder into stormEncoders, polled by serviceStorms() until
+	// the pins have been still for stormQuietMicros. pollDriven stays false, as it shares a byte with flags written in
+	// main context.
+	static NewEncoder *stormEncoders;
+	static constexpr uint8_t STORM_NONE = 0;
+	static constexpr uint8_t STORM_DETACH_PENDING = 1;  // Interrupts still attached but ignored (functional ISRs, end())
+	static constexpr uint8_t STORM_POLLING = 2;
+	volatile uint8_t stormState = STORM_NONE;
+	uint16_t stormMaxEdges = 0;  // 0 - disabled
+	volatile uint16_t stormEdges = 0;
+	uint32_t stormWindowMicros = 10000UL;
+	uint32_t stormQuietMicros = 100000UL;
+	volatile uint32_t stormWindowStart = 0;
+	volatile uint32_t storms = 0;
+	volatile uint32_t stormMillis = 0;  // Completed storms
+	volatile uint32_t stormStartMillis = 0;
+#endif
 
 	uint8_t _aPin = 0, _bPin = 0;
 	const encoderStateTransition *tablePtr = nullptr;
-	volatile uint8_t _aPinValue, _bPinValue;
+	volatile uint8_t _aPinValue, _bPinValue;  // Not packed: bit-field read-modify-writes on every edge cost more than they save
 	volatile uint8_t currentStateVariable;
+#if NEWENCODER_CLICK_FLAGS
+#if NEWENCODER_COMPACT
+	// Share a byte written by the ISR, so main-context writers must disable interrupts
+	volatile bool clickUp :1;
+	volatile bool clickDown :1;
+#else
+	volatile bool clickUp = false;
+	volatile bool clickDown = false;
+#endif
+#endif
 	volatile IO_REG_TYPE *_aPin_register;
 	volatile IO_REG_TYPE *_bPin_register;
 	volatile IO_REG_TYPE _aPin_bitmask;
 	volatile IO_REG_TYPE _bPin_bitmask;
-	volatile bool clickUp = false;
-	volatile bool clickDown = false;
+#if NEWENCODER_TRANSITION_COUNTS
+	volatile uint32_t invalidTransitions = 0;
+	volatile uint32_t inferredTransitions = 0;  // Two-pin jumps replayed in the direction of recent motion
+#endif
+#if NEWENCODER_DETENT_DELTA
+	volatile uint32_t detentDelta = 0;  // Net detents since readAndClearDelta(), two's complement. Not clamped or reset by the value.
+#endif
 
-	static const encoderStateTransition fullPulseTransitionTable[];
-	static const encoderStateTransition halfPulseTransitionTable[];
+#if NEWENCODER_GLITCH_FILTER
+	// Glitch filter. A pin change less than filterTicks after the pin's last accepted change is dropped.
+	volatile uint32_t filterTicks = 0;  // 0 - filter disabled
+	volatile uint32_t lastAEdgeTime = 0;
+	volatile uint32_t lastBEdgeTime = 0;
+	volatile uint32_t filteredEdges = 0;
+	static constexpr uint8_t FILTER_PENDING_A = 0b01;  // Same bit order as the B/A levels
+	static constexpr uint8_t FILTER_PENDING_B = 0b10;
+	volatile uint8_t filterPending = 0;  // Pins whose last change was dropped. Their level may differ from _aPinValue / _bPinValue.
+#endif
+
+	// Samples of both pins (syncPins(), applyPinLevels(), quadSample())
+	static constexpr uint8_t PIN_A = 0b01;  // Same bit order as the B/A levels
+	static constexpr uint8_t PIN_B = 0b10;
+	volatile uint8_t lastPinChanged = 0;  // PIN_A, PIN_B, or 0 if unknown
+	volatile int8_t lastStepDirection = 0;  // QUAD modes: 1 / -1 for the last single step, 0 if unknown
+
+#if NEWENCODER_STATS
+	void readStats(EncoderStats &stats);
+	volatile EncoderStats liveStats;
+#if defined(__AVR__)
+	using StatsSequence = uint8_t;  // Only an ISR can interrupt the reader
+#else
+	using StatsSequence = uint32_t;  // Wide enough not to wrap while a preempted reader task is copying
+#endif
+	volatile StatsSequence statsSequence = 0;  // Odd while an ISR is updating liveStats
+	EncoderStats statsBaseline;
+#endif
 
 	EncoderCallBack callBackPtr = nullptr;
 	void *userPointer = nullptr;
+#if NEWENCODER_DEFERRED
+	volatile int8_t deferredSlot = -1;  // Index in deferredEncoders[] if the callback is deferred or a coroutine awaits
+	volatile bool deferCallback = false;
+#endif
+
+	// waitForChange() / nextEvent(). The ISR wakes a waiter once and disarms it. So, any number of detents
+	// before the waiter runs again cost one wakeup.
+#if defined(ESP32)
+	volatile TaskHandle_t waitingTask = nullptr;
+#elif defined(NEWENCODER_HOST)
+	HostHal::Notification changeNotification;
+	volatile bool waiterArmed = false;
+#endif
+#if NEWENCODER_COROUTINES
+	void *volatile awaitingCoroutine = nullptr;  // coroutine_handle address, resumed by service()
+#endif
+
+#if NEWENCODER_DEFERRED
+	static_assert(NEWENCODER_MAX_DEFERRED <= 32, "NEWENCODER_MAX_DEFERRED must be 32 or less");
+	static NewEncoder *deferredEncoders[NEWENCODER_MAX_DEFERRED];
+	static volatile uint32_t deferredPending;  // Bit n set - deferredEncoders[n] has a callback to dispatch
+#if defined(ESP32)
+	static void serviceTask(void *pvParameters);
+	static volatile TaskHandle_t serviceTaskHandle;
+#endif
+#endif
+#if NEWENCODER_EVENT_QUEUE
+	EventQueue *eventQueue = nullptr;
+#endif
+#if NEWENCODER_TRACE
+	TraceRing *traceRing = nullptr;
+#endif
+#if NEWENCODER_ACCELERATION
+	const AccelerationStep *accelerationCurve = nullptr;
+	uint8_t accelerationSteps = 0;
+	uint8_t lastDetentDelta = 0;
+	uint32_t lastDetentTime = 0;
+	uint32_t lastDetentMillis = 0;
+#endif
+
+#if NEWENCODER_RATE
+	// Rate measurement. The filtered period is in microseconds, fixed point with RATE_FRACTION_BITS fraction bits.
+	static constexpr uint8_t RATE_FRACTION_BITS = 4;
+	static constexpr uint8_t RATE_FILTER_SHIFT = 2;  // Each new interval has 1/4 weight
+	volatile RateUnits rateUnits = RateOff;
+	uint32_t rateTimeoutMicros = 1000000UL;
+	volatile uint32_t filteredPeriod = 0;
+	volatile uint32_t lastRateTime = 0;
+	volatile uint8_t rateSamples = 0;
+	volatile int8_t rateDirection = 0;
+#endif
+
+#if NEWENCODER_ATOMIC_STATE
+	uint32_t exchangeValue(EncoderValue val);
+	void publishState(uint8_t updatedStateVariable);
+	volatile uint32_t publishedState = 0;  // currentValue, currentClick, and stateChanged packed for atomic access
+#endif
+
+	// Bit n set - interrupt n is attached outside the trampolines: claimed by NewEncoderT, or by an encoder with
+	// functional ISRs (which have no table to record it in)
+	static uint8_t _claimedInterrupts[(CORE_NUM_INTERRUPT + 7) / 8];
+	static bool interruptClaimed(uint8_t intNumber);
 
 #ifndef USE_FUNCTIONAL_ISR
 	using PinChangeFunction = void (NewEncoder::*)();
 	using isrFunct = void (*)();
 
+#if NEWENCODER_SHARED_INTERRUPTS
+	// Node of the intrusive chain of pin change functions run by one interrupt number.
+	// Encoders sharing an interrupt are all linked into its chain.
+	struct isrLink {
+		NewEncoder *objectPtr;
+		PinChangeFunction functPtr;
+		isrLink *next;
+	};
+	isrLink aPinLink = { nullptr, nullptr, nullptr };
+	isrLink bPinLink = { nullptr, nullptr, nullptr };
+	static isrLink *_isrChain[CORE_NUM_INTERRUPT];
+#else
+	// Pin change function run by one interrupt number. objectPtr is nullptr while the interrupt is free.
 	struct isrInfo {
 		NewEncoder *objectPtr;
 		PinChangeFunction functPtr;
 	};
 	static isrInfo _isrTable[CORE_NUM_INTERRUPT];
+#endif
+
+	bool linkIsr(uint8_t intNumber, uint8_t pin, PinChangeFunction functPtr);
+	bool unlinkIsr(uint8_t intNumber, uint8_t pin);
 
-	template<uint8_t NUM_INTERRUPTS = CORE_NUM_INTERRUPT>
-	static isrFunct getIsr(uint8_t intNumber);
+	template<uint8_t INTERRUPT_NUMBER>
+	static void isrTrampoline();
+
+	template<uint8_t ... INTERRUPT_NUMBERS>
+	struct IndexSequence {
+	};
+	template<uint8_t N, uint8_t ... INTERRUPT_NUMBERS>
+	struct MakeIndexSequence: MakeIndexSequence<N - 1, N - 1, INTERRUPT_NUMBERS...> {
+	};
+	template<uint8_t ... INTERRUPT_NUMBERS>
+	struct MakeIndexSequence<0, INTERRUPT_NUMBERS...> {
+		using type = IndexSequence<INTERRUPT_NUMBERS...>;
+	};
+
+	// Table of isrTrampoline<0> ... isrTrampoline<CORE_NUM_INTERRUPT - 1>, indexed by interrupt number
+	template<typename Sequence>
+	struct TrampolineTable;
+	using Trampolines = TrampolineTable<MakeIndexSequence<CORE_NUM_INTERRUPT>::type>;
 #endif
 
 // -------- Deprecated Public Functions ---------
 public:
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	int16_t setValue(int16_t);
+	EncoderValue setValue(EncoderValue);
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	int16_t getValue();
+	EncoderValue getValue();
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	int16_t operator=(int16_t val);
+	EncoderValue operator=(EncoderValue val);
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	int16_t getAndSet(int16_t val = 0);
+	EncoderValue getAndSet(EncoderValue val = 0);
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	operator int16_t() const;
+	operator EncoderValue() const;
 
+#if NEWENCODER_CLICK_FLAGS
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
 	bool upClick();
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
 	bool downClick();
+#endif
 
 	[[deprecated ("May be removed in future release. See README and library examples.")]]
-	bool newSettings(int16_t newMin, int16_t newMax, int16_t newCurrent);
+	bool newSettings(EncoderValue newMin, EncoderValue newMax, EncoderValue newCurrent);
 };
 
-#ifndef USE_FUNCTIONAL_ISR
-template<uint8_t NUM_INTERRUPTS>
-NewEncoder::isrFunct NewEncoder::getIsr(uint8_t intNumber) {
-	if (intNumber == (NUM_INTERRUPTS - 1)) {
-		return [] {
-			((_isrTable[NUM_INTERRUPTS - 1].objectPtr)->*(_isrTable[NUM_INTERRUPTS - 1].functPtr))();
-		};
-	}
-	return getIsr<NUM_INTERRUPTS - 1>(intNumber);
+#if NEWENCODER_ATOMIC_STATE
+// Packing of the value, click, and changed flag into the word NewEncoder and NewEncoderT publish with
+// NEWENCODER_ATOMIC_STATE
+namespace NewEncoderAtomic {
+
+using PackedState = uint32_t;
+using SignedPackedState = int32_t;
+
+// Layout of the published word: bit 0 stateChanged, bits 1-2 currentClick, remaining bits currentValue (sign-extended)
+constexpr PackedState ATOMIC_CHANGED_BIT = 0b001;
+constexpr uint8_t ATOMIC_CLICK_SHIFT = 1;
+constexpr PackedState ATOMIC_FLAG_MASK = 0b111;
+constexpr uint8_t ATOMIC_VALUE_SHIFT = 3;
+
+inline PackedState packValue(NewEncoder::EncoderValue value) {
+	return static_cast<PackedState>(static_cast<SignedPackedState>(value)) << ATOMIC_VALUE_SHIFT;
+}
+
+inline NewEncoder::EncoderValue unpackValue(PackedState packed) {
+	return static_cast<NewEncoder::EncoderValue>(static_cast<SignedPackedState>(packed) >> ATOMIC_VALUE_SHIFT);
+}
+
+inline PackedState packState(NewEncoder::EncoderValue value, NewEncoder::EncoderClick click, bool changed) {
+	return packValue(value) | (static_cast<PackedState>(click) << ATOMIC_CLICK_SHIFT) | (changed ? ATOMIC_CHANGED_BIT : 0);
 }
 
-template<>
-inline NewEncoder::isrFunct NewEncoder::getIsr<0>(uint8_t intNum) {
-	(void) intNum;
-	return nullptr;
+inline void unpackState(PackedState packed, NewEncoder::EncoderState &state) {
+	state.currentValue = unpackValue(packed);
+	if ((packed & ATOMIC_CHANGED_BIT) != 0) {
+		state.currentClick = static_cast<NewEncoder::EncoderClick>((packed >> ATOMIC_CLICK_SHIFT) & 0b11);
+	} else {
+		state.currentClick = NewEncoder::NoClick;
+	}
 }
+
+} // namespace NewEncoderAtomic
 #endif
 
+// State names are only needed to write the tables above
+#undef START_STATE
+#undef CW_STATE_1
+#undef CW_STATE_2
+#undef CW_STATE_3
+#undef CCW_STATE_1
+#undef CCW_STATE_2
+#undef CCW_STATE_3
+#undef DETENT_0
+#undef DETENT_1
+#undef DEBOUNCE_0
+#undef DEBOUNCE_1
+#undef DEBOUNCE_2
+#undef DEBOUNCE_3
+
 #endif /* NEWENCODER_H_ */
@@ -0,0 +1,48 @@
+/*
+ * NewEncoderEeprom.h
+ */
+#ifndef NEWENCODEREEPROM_H_
+#define NEWENCODEREEPROM_H_
+
+#include <EEPROM.h>
+#include "NewEncoderStore.h"
+
+// NewEncoderStore::Storage on the Arduino EEPROM library, using 'eepromSize' bytes from address 'eepromStart'.
+// Bytes that already hold the value aren't rewritten. On ESP8266 / ESP32 (EEPROM emulated in flash),
+// call EEPROM.begin() with a size of at least eepromStart + eepromSize first. Each record is then committed to flash.
+class NewEncoderEeprom: public NewEncoderStore::Storage {
+public:
+	NewEncoderEeprom(uint32_t eepromStart, uint32_t eepromSize) :
+			start(eepromStart), length(eepromSize) {
+	}
+
+	uint32_t size() const override {
+		return length;
+	}
+
+	void read(uint32_t address, uint8_t *buffer, uint16_t count) override {
+		for (uint16_t i = 0; i < count; i++) {
+			buffer[i] = EEPROM.read(start + address + i);
+		}
+	}
+
+	void write(uint32_t address, const uint8_t *data, uint16_t count) override {
+		for (uint16_t i = 0; i < count; i++) {
+			if (EEPROM.read(start + address + i) != data[i]) {
+				EEPROM.write(start + address + i, data[i]);
+			}
+		}
+	}
+
+	void commit() override {
+#if defined(ESP8266) || defined(ESP32)
+		EEPROM.commit();
+#endif
+	}
+
+private:
+	uint32_t start;
+	uint32_t length;
+};
+
+#endif /* NEWENCODEREEPROM_H_ */
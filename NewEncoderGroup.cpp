@@ -0,0 +1,110 @@
+/*
+ * NewEncoderGroup.cpp
+ */
+
+#include "NewEncoderGroup.h"
+
+NewEncoderGroup::NewEncoderGroup() {
+}
+
+NewEncoderGroup::~NewEncoderGroup() {
+	end();
+}
+
+bool NewEncoderGroup::add(NewEncoder &encoder) {
+	if (active) {
+		return false;
+	}
+	if (numMembers >= NEWENCODER_MAX_GROUP_ENCODERS) {
+		return false;
+	}
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i] == &encoder) {
+			return false;
+		}
+	}
+	members[numMembers++] = &encoder;
+	return true;
+}
+
+// Same as calling begin() on every member, but with one pin settle delay. Nothing is started unless all can be.
+bool NewEncoderGroup::begin() {
+	if (active) {
+		return false;
+	}
+	if (numMembers == 0) {
+		return false;
+	}
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i]->portDriven || !members[i]->interruptsAvailable()) {
+			return false;
+		}
+#if defined(USE_FUNCTIONAL_ISR) || !NEWENCODER_SHARED_INTERRUPTS
+		// An interrupt serves one encoder. interruptsAvailable() only sees the encoders already started.
+		for (uint8_t j = 0; j < i; j++) {
+			if (members[i]->sharesInterrupt(*members[j])) {
+				return false;
+			}
+		}
+#endif
+	}
+
+	for (uint8_t i = 0; i < numMembers; i++) {
+		members[i]->initPins();
+	}
+	delay(2);  // Seems to help ensure first reading after pinMode is correct
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (!members[i]->startInterrupts()) {
+			for (uint8_t j = 0; j < i; j++) {
+				members[j]->end();
+			}
+			return false;
+		}
+	}
+	active = true;
+	return true;
+}
+
+void NewEncoderGroup::end() {
+	if (!active) {
+		return;
+	}
+	active = false;
+	for (uint8_t i = 0; i < numMembers; i++) {
+		members[i]->end();
+	}
+}
+
+bool NewEncoderGroup::enabled() const {
+	return active;
+}
+
+uint8_t NewEncoderGroup::count() const {
+	return numMembers;
+}
+
+// Fill states[0 .. count()-1] like getState() on each member. Only changed members' live states are copied, all in
+// one critical section. So, the snapshot is consistent across the group. With NEWENCODER_ATOMIC_STATE, each
+// member's state is read atomically on its own instead.
+NewEncoderGroup::ChangedMask NewEncoderGroup::getStates(NewEncoder::EncoderState *states) {
+	ChangedMask changed = 0;
+#if NEWENCODER_ATOMIC_STATE
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i]->getState(states[i])) {
+			changed |= static_cast<ChangedMask>(1) << i;
+		}
+	}
+#else
+	noInterrupts();
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i]->latchState()) {
+			changed |= static_cast<ChangedMask>(1) << i;
+		}
+	}
+	interrupts();
+	for (uint8_t i = 0; i < numMembers; i++) {
+		memcpy((void*) &states[i], (void*) &members[i]->localState, sizeof(NewEncoder::EncoderState));
+	}
+#endif
+	return changed;
+}
@@ -0,0 +1,38 @@
+/*
+ * NewEncoderGroup.h
+ */
+#ifndef NEWENCODERGROUP_H_
+#define NEWENCODERGROUP_H_
+
+#include "NewEncoder.h"
+
+#ifndef NEWENCODER_MAX_GROUP_ENCODERS
+#define NEWENCODER_MAX_GROUP_ENCODERS 16
+#endif
+
+// Starts many interrupt-driven encoders with one pin settle delay and reads all of their states in
+// one critical section. getStates() returns a bitmask of the members that changed, bit n = n-th added.
+class NewEncoderGroup {
+public:
+	using ChangedMask = uint32_t;
+	static_assert(NEWENCODER_MAX_GROUP_ENCODERS <= 32, "NEWENCODER_MAX_GROUP_ENCODERS must be 32 or less");
+
+	NewEncoderGroup();
+	~NewEncoderGroup();
+	bool add(NewEncoder &encoder);
+	bool begin();
+	void end();
+	bool enabled() const;
+	uint8_t count() const;
+	ChangedMask getStates(NewEncoder::EncoderState *states);
+
+	NewEncoderGroup(const NewEncoderGroup&) = delete; // delete copy constructor. no copying allowed
+	NewEncoderGroup& operator=(const NewEncoderGroup&) = delete; // delete operator=(). no assignment allowed
+
+private:
+	NewEncoder *members[NEWENCODER_MAX_GROUP_ENCODERS];
+	uint8_t numMembers = 0;
+	bool active = false;
+};
+
+#endif /* NEWENCODERGROUP_H_ */
@@ -0,0 +1,148 @@
+/*
+ * NewEncoderPort.cpp
+ */
+
+#include "NewEncoderPort.h"
+
+#ifdef DIRECT_PORT_READ
+
+NewEncoderPort::NewEncoderPort() {
+}
+
+NewEncoderPort::~NewEncoderPort() {
+	end();
+}
+
+bool NewEncoderPort::add(NewEncoder &encoder) {
+	if (active) {
+		return false;
+	}
+	if (numMembers >= NEWENCODER_MAX_PORT_ENCODERS) {
+		return false;
+	}
+	if (encoder.active) {
+		return false;  // Already started by its own begin(). Its edges would be counted twice.
+	}
+	if (!encoder.validConfiguration()) {
+		return false;
+	}
+	if (encoder._aPin_register != encoder._bPin_register) {
+		return false;
+	}
+	if (portRegister == nullptr) {
+		portRegister = encoder._aPin_register;
+	} else if (encoder._aPin_register != portRegister) {
+		return false;
+	}
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i].encoder == &encoder) {
+			return false;
+		}
+	}
+#if defined(__AVR__) && defined(PCICR)
+	if ((digitalPinToPCMSK(encoder._aPin) == nullptr) || (digitalPinToPCMSK(encoder._bPin) == nullptr)) {
+		return false;
+	}
+#endif
+
+	members[numMembers].encoder = &encoder;
+	members[numMembers].pinMask = encoder._aPin_bitmask | encoder._bPin_bitmask;
+	numMembers++;
+	return true;
+}
+
+bool NewEncoderPort::begin() {
+	if (active) {
+		return false;
+	}
+	if (numMembers == 0) {
+		return false;
+	}
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i].encoder->active || !members[i].encoder->validConfiguration()) {
+			return false;
+		}
+	}
+
+	for (uint8_t i = 0; i < numMembers; i++) {
+		members[i].encoder->initPins();
+	}
+	delay(2);  // Seems to help ensure first reading after pinMode is correct
+
+	noInterrupts();
+	lastSnapshot = DIRECT_PORT_READ(portRegister);
+	for (uint8_t i = 0; i < numMembers; i++) {
+		NewEncoder *encoder = members[i].encoder;
+		encoder->readPinState();
+		encoder->portDriven = true;
+		encoder->active = true;
+	}
+	active = true;
+	interrupts();
+	enablePinChangeInterrupts(true);
+	return true;
+}
+
+void NewEncoderPort::end() {
+	if (!active) {
+		return;
+	}
+	enablePinChangeInterrupts(false);
+	noInterrupts();
+	active = false;
+	interrupts();
+	for (uint8_t i = 0; i < numMembers; i++) {
+		members[i].encoder->end();
+	}
+}
+
+bool NewEncoderPort::enabled() const {
+	return active;
+}
+
+uint8_t NewEncoderPort::count() const {
+	return numMembers;
+}
+
+void ESP_ISR NewEncoderPort::portChange() {
+	if (!active) {
+		return;
+	}
+	IO_REG_TYPE snapshot = DIRECT_PORT_READ(portRegister);
+	IO_REG_TYPE changed = snapshot ^ lastSnapshot;
+	if (changed == 0) {
+		return;
+	}
+	lastSnapshot = snapshot;
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (((changed & members[i].pinMask) != 0) && members[i].encoder->active) {
+			members[i].encoder->portSample(snapshot);
+		}
+	}
+}
+
+void NewEncoderPort::enablePinChangeInterrupts(bool enable) {
+#if defined(__AVR__) && defined(PCICR)
+	// Unmask the pin-change interrupt of every member pin. The user supplies the ISR(PCINTx_vect) that calls portChange().
+	for (uint8_t i = 0; i < numMembers; i++) {
+		const uint8_t pins[] = { members[i].encoder->_aPin, members[i].encoder->_bPin };
+		for (uint8_t pin : pins) {
+			volatile uint8_t *pcmsk = digitalPinToPCMSK(pin);
+			if (pcmsk == nullptr) {
+				continue;
+			}
+			if (enable) {
+				*pcmsk |= _BV(digitalPinToPCMSKbit(pin));
+				PCIFR = _BV(digitalPinToPCICRbit(pin));
+				*digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+			} else {
+				*pcmsk &= ~_BV(digitalPinToPCMSKbit(pin));
+			}
+		}
+	}
+#else
+	(void) enable;
+#endif
+}
+
+#endif /* DIRECT_PORT_READ */
@@ -0,0 +1,51 @@
+/*
+ * NewEncoderPort.h
+ */
+#ifndef NEWENCODERPORT_H_
+#define NEWENCODERPORT_H_
+
+#include "NewEncoder.h"
+
+#ifdef DIRECT_PORT_READ
+
+#ifndef NEWENCODER_MAX_PORT_ENCODERS
+#define NEWENCODER_MAX_PORT_ENCODERS 16
+#endif
+
+// Decodes every encoder wired to one GPIO port from a single port-change interrupt.
+// The ISR takes one snapshot of the port's input register and advances the state machine of each
+// registered encoder whose pins changed. Encoders don't need interrupt-capable pins of their own.
+class NewEncoderPort {
+public:
+	NewEncoderPort();
+	~NewEncoderPort();
+	bool add(NewEncoder &encoder);
+	bool begin();
+	void end();
+	bool enabled() const;
+	uint8_t count() const;
+
+	// Call from the port's pin-change ISR (e.g. ISR(PCINT2_vect) on AVR).
+	void portChange();
+
+	NewEncoderPort(const NewEncoderPort&) = delete; // delete copy constructor. no copying allowed
+	NewEncoderPort& operator=(const NewEncoderPort&) = delete; // delete operator=(). no assignment allowed
+
+private:
+	struct PortMember {
+		NewEncoder *encoder;
+		IO_REG_TYPE pinMask;
+	};
+
+	void enablePinChangeInterrupts(bool enable);
+
+	PortMember members[NEWENCODER_MAX_PORT_ENCODERS];
+	uint8_t numMembers = 0;
+	volatile IO_REG_TYPE *portRegister = nullptr;
+	volatile IO_REG_TYPE lastSnapshot = 0;
+	bool active = false;
+};
+
+#endif /* DIRECT_PORT_READ */
+
+#endif /* NEWENCODERPORT_H_ */
@@ -0,0 +1,220 @@
+/*
+ * NewEncoderStore.cpp
+ */
+
+#include <string.h>
+#include "NewEncoderStore.h"
+
+// Record layout, native byte order: uint32_t sequence, uint8_t numValues, uint8_t sizeof(EncoderValue),
+// numValues values, CRC-16 of the preceding bytes. Erased (0xFF) storage never has a valid CRC for numValues 0xFF.
+
+NewEncoderStore::NewEncoderStore(Storage &nonVolatile, uint8_t valueCount) :
+		storage(nonVolatile), numValues((valueCount < NEWENCODER_MAX_STORE_ENCODERS) ? valueCount : NEWENCODER_MAX_STORE_ENCODERS) {
+	for (uint8_t i = 0; i < NEWENCODER_MAX_STORE_ENCODERS; i++) {
+		members[i] = nullptr;
+		restoredValues[i] = 0;
+		savedValues[i] = 0;
+		lastValues[i] = 0;
+	}
+}
+
+// Find the newest complete record. Call once at boot, before add(). Returns false if there is none.
+bool NewEncoderStore::restore() {
+	uint32_t numSlots = slots();
+	uint32_t newestSequence = 0;
+	restored = false;
+	if (numSlots < 2) {
+		return false;
+	}
+	for (uint32_t slot = 0; slot < numSlots; slot++) {
+		uint32_t sequence;
+		if (!readRecord(slot, sequence)) {
+			continue;
+		}
+		if (restored && (static_cast<int32_t>(sequence - newestSequence) <= 0)) {
+			continue;
+		}
+		restored = true;
+		newestSequence = sequence;
+		nextSlot = (slot + 1) % numSlots;
+		memcpy(restoredValues, record + HEADER_BYTES, numValues * sizeof(EncoderValue));
+	}
+	if (restored) {
+		nextSequence = newestSequence + 1;
+		memcpy(savedValues, restoredValues, sizeof(savedValues));
+	}
+	return restored;
+}
+
+// Value to pass to configure() (or the constructor) as the initial value
+NewEncoderStore::EncoderValue NewEncoderStore::restoredValue(uint8_t index, EncoderValue defaultValue) const {
+	if (!restored || (index >= numValues)) {
+		return defaultValue;
+	}
+	return restoredValues[index];
+}
+
+// Members are stored in the order they are added. Add them after configure() with restoredValue().
+bool NewEncoderStore::add(NewEncoder &encoder) {
+	if (numMembers >= numValues) {
+		return false;
+	}
+	for (uint8_t i = 0; i < numMembers; i++) {
+		if (members[i] == &encoder) {
+			return false;
+		}
+	}
+	EncoderValue value = encoder.peekValue();
+	lastValues[numMembers] = value;
+	if (!restored) {
+		savedValues[numMembers] = value;  // Nothing to save until it changes
+	}
+	members[numMembers++] = &encoder;
+	return true;
+}
+
+// A record is written once no member has changed for idleMillis, or once a change has waited maxDelayMillis
+void NewEncoderStore::setTiming(uint32_t idleMillis, uint32_t maxDelayMillis) {
+	idleTime = idleMillis;
+	maxDelay = maxDelayMillis;
+}
+
+// Changes of these members (bit n = n-th added) are written at the next update() without waiting
+void NewEncoderStore::setUrgentMask(DirtyMask mask) {
+	urgentMask = mask;
+}
+
+// Limit the bytes written per update() call, e.g. 1 on AVR where each EEPROM byte takes 3.3 ms. 0 - no limit.
+void NewEncoderStore::setChunkBytes(uint16_t bytes) {
+	chunkBytes = bytes;
+}
+
+// Call from loop(). Returns true when a record has been completely written.
+bool NewEncoderStore::update() {
+	uint32_t now = millis();
+	scan(now);
+	if (!writing && (dirtyMask != 0)
+			&& (((dirtyMask & urgentMask) != 0) || ((now - lastChangeMillis) >= idleTime) || ((now - firstDirtyMillis) >= maxDelay))) {
+		startRecord();
+	}
+	if (writing) {
+		return writeChunk(chunkBytes);
+	}
+	return false;
+}
+
+// Write any change now and finish a record in progress, e.g. before sleeping or when power is failing
+void NewEncoderStore::flush() {
+	if (!writing) {
+		scan(millis());
+		if (dirtyMask != 0) {
+			startRecord();
+		}
+	}
+	if (writing) {
+		writeChunk(0);
+	}
+}
+
+NewEncoderStore::DirtyMask NewEncoderStore::dirty() const {
+	return dirtyMask;
+}
+
+uint16_t NewEncoderStore::recordBytes() const {
+	return HEADER_BYTES + numValues * sizeof(EncoderValue) + CRC_BYTES;
+}
+
+uint32_t NewEncoderStore::slots() const {
+	return storage.size() / recordBytes();
+}
+
+uint32_t NewEncoderStore::recordsWritten() const {
+	return written;
+}
+
+void NewEncoderStore::scan(uint32_t now) {
+	DirtyMask newDirtyMask = 0;
+	for (uint8_t i = 0; i < numMembers; i++) {
+		EncoderValue value = members[i]->peekValue();
+		if (value != lastValues[i]) {
+			lastValues[i] = value;
+			lastChangeMillis = now;
+		}
+		if (value != savedValues[i]) {
+			newDirtyMask |= 1UL << i;  // Unsaved change. A member turned back to its saved value stays out - clean again
+		}
+	}
+	if ((dirtyMask == 0) && (newDirtyMask != 0)) {
+		firstDirtyMillis = now;
+	}
+	dirtyMask = newDirtyMask;
+}
+
+uint16_t NewEncoderStore::crc16(const uint8_t *data, uint16_t length) {
+	uint16_t crc = 0xFFFF;  // CRC-16/CCITT-FALSE
+	while (length-- != 0) {
+		crc ^= static_cast<uint16_t>(*data++) << 8;
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+		}
+	}
+	return crc;
+}
+
+// Read a slot into record[]. True if it holds a complete record for this configuration.
+bool NewEncoderStore::readRecord(uint32_t slot, uint32_t &sequence) {
+	uint16_t length = recordBytes();
+	storage.read(slot * length, record, length);
+	if ((record[4] != numValues) || (record[5] != sizeof(EncoderValue))) {
+		return false;
+	}
+	uint16_t crc;
+	memcpy(&crc, record + length - CRC_BYTES, CRC_BYTES);
+	if (crc != crc16(record, length - CRC_BYTES)) {
+		return false;
+	}
+	memcpy(&sequence, record, sizeof(sequence));
+	return true;
+}
+
+// Snapshot the current values into record[]. Members not added keep their restored values.
+void NewEncoderStore::startRecord() {
+	for (uint8_t i = 0; i < numMembers; i++) {
+		savedValues[i] = lastValues[i];
+	}
+	dirtyMask = 0;
+	uint16_t length = recordBytes();
+	memcpy(record, &nextSequence, sizeof(nextSequence));
+	record[4] = numValues;
+	record[5] = sizeof(EncoderValue);
+	memcpy(record + HEADER_BYTES, savedValues, numValues * sizeof(EncoderValue));
+	uint16_t crc = crc16(record, length - CRC_BYTES);
+	memcpy(record + length - CRC_BYTES, &crc, CRC_BYTES);
+	writeOffset = 0;
+	writing = true;
+}
+
+// Write up to maxBytes (0 - the rest) of the record in progress. True if it is complete.
+bool NewEncoderStore::writeChunk(uint16_t maxBytes) {
+	uint32_t numSlots = slots();
+	if (numSlots < 2) {
+		writing = false;  // No room for a ring. Nothing is stored.
+		return false;
+	}
+	uint16_t length = recordBytes();
+	uint16_t bytes = length - writeOffset;
+	if ((maxBytes != 0) && (bytes > maxBytes)) {
+		bytes = maxBytes;
+	}
+	storage.write(nextSlot * length + writeOffset, record + writeOffset, bytes);
+	writeOffset += bytes;
+	if (writeOffset < length) {
+		return false;
+	}
+	storage.commit();
+	writing = false;
+	written++;
+	nextSlot = (nextSlot + 1) % numSlots;
+	nextSequence++;
+	return true;
+}
@@ -0,0 +1,90 @@
+/*
+ * NewEncoderStore.h
+ */
+#ifndef NEWENCODERSTORE_H_
+#define NEWENCODERSTORE_H_
+
+#include "NewEncoder.h"
+
+#ifndef NEWENCODER_MAX_STORE_ENCODERS
+#define NEWENCODER_MAX_STORE_ENCODERS 8
+#endif
+
+// Saves the values of several encoders to non-volatile storage and restores them at boot. Changes are coalesced:
+// one record with every value is written once the encoders have been idle for a while, once they have been dirty
+// for too long, or right away for members in the urgent mask. Records go to the next slot of a ring that fills the
+// storage, so each slot is written once per lap (wear leveling). A sequence number and CRC in each record let
+// restore() find the newest complete one, even after power was lost in the middle of a write.
+class NewEncoderStore {
+public:
+	using EncoderValue = NewEncoder::EncoderValue;
+	using DirtyMask = uint32_t;
+	static_assert(NEWENCODER_MAX_STORE_ENCODERS <= 32, "NEWENCODER_MAX_STORE_ENCODERS must be 32 or less");
+
+	// Byte-addressable non-volatile memory. Addresses are 0 .. size() - 1 within the area given to the store.
+	class Storage {
+	public:
+		virtual ~Storage() {
+		}
+		virtual uint32_t size() const = 0;
+		virtual void read(uint32_t address, uint8_t *buffer, uint16_t length) = 0;
+		virtual void write(uint32_t address, const uint8_t *data, uint16_t length) = 0;
+		virtual void commit() {  // Called after each complete record, e.g. for EEPROM emulated in flash
+		}
+	};
+
+	static constexpr uint16_t HEADER_BYTES = 6;  // Sequence number, number of values, bytes per value
+	static constexpr uint16_t CRC_BYTES = 2;
+
+	NewEncoderStore(Storage &nonVolatile, uint8_t valueCount);
+	bool restore();
+	EncoderValue restoredValue(uint8_t index, EncoderValue defaultValue) const;
+	bool add(NewEncoder &encoder);
+	void setTiming(uint32_t idleMillis, uint32_t maxDelayMillis);
+	void setUrgentMask(DirtyMask mask);
+	void setChunkBytes(uint16_t bytes);
+	bool update();
+	void flush();
+	DirtyMask dirty() const;
+	uint16_t recordBytes() const;
+	uint32_t slots() const;
+	uint32_t recordsWritten() const;
+
+	NewEncoderStore(const NewEncoderStore&) = delete; // delete copy constructor. no copying allowed
+	NewEncoderStore& operator=(const NewEncoderStore&) = delete; // delete operator=(). no assignment allowed
+
+private:
+	void scan(uint32_t now);
+	static uint16_t crc16(const uint8_t *data, uint16_t length);
+	bool readRecord(uint32_t slot, uint32_t &sequence);
+	void startRecord();
+	bool writeChunk(uint16_t maxBytes);
+
+	static constexpr uint16_t MAX_RECORD_BYTES = HEADER_BYTES + NEWENCODER_MAX_STORE_ENCODERS * sizeof(EncoderValue) + CRC_BYTES;
+
+	Storage &storage;
+	uint8_t numValues;
+	uint8_t numMembers = 0;
+	NewEncoder *members[NEWENCODER_MAX_STORE_ENCODERS];
+	EncoderValue restoredValues[NEWENCODER_MAX_STORE_ENCODERS];
+	EncoderValue savedValues[NEWENCODER_MAX_STORE_ENCODERS];  // In the newest record, complete or being written
+	EncoderValue lastValues[NEWENCODER_MAX_STORE_ENCODERS];  // At the previous update()
+	bool restored = false;
+
+	uint32_t idleTime = 1000;  // Milliseconds
+	uint32_t maxDelay = 10000;
+	DirtyMask urgentMask = 0;
+	DirtyMask dirtyMask = 0;  // Bit n set - member n differs from savedValues[n]
+	uint32_t lastChangeMillis = 0;
+	uint32_t firstDirtyMillis = 0;
+
+	uint8_t record[MAX_RECORD_BYTES];
+	uint16_t chunkBytes = 0;  // 0 - write a whole record in one update()
+	uint16_t writeOffset = 0;
+	bool writing = false;
+	uint32_t nextSlot = 0;
+	uint32_t nextSequence = 1;
+	uint32_t written = 0;
+};
+
+#endif /* NEWENCODERSTORE_H_ */
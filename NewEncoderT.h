@@ -0,0 +1,325 @@
+/*
+ * NewEncoderT.h
+ */
+#ifndef NEWENCODERT_H_
+#define NEWENCODERT_H_
+
+#include "NewEncoder.h"
+
+// Value policies for NewEncoderT. Each returns the new value for one detent up / down.
+
+// Stop at minValue / maxValue - same behavior as NewEncoder
+struct SaturateValue {
+	static inline NewEncoder::EncoderValue increment(NewEncoder::EncoderValue value, NewEncoder::EncoderValue minValue,
+			NewEncoder::EncoderValue maxValue) {
+		(void) minValue;
+		return (value < maxValue) ? value + 1 : value;
+	}
+	static inline NewEncoder::EncoderValue decrement(NewEncoder::EncoderValue value, NewEncoder::EncoderValue minValue,
+			NewEncoder::EncoderValue maxValue) {
+		(void) maxValue;
+		return (value > minValue) ? value - 1 : value;
+	}
+};
+
+// Wrap around at minValue / maxValue - same behavior as the CustomEncoder example
+struct WrapValue {
+	static inline NewEncoder::EncoderValue increment(NewEncoder::EncoderValue value, NewEncoder::EncoderValue minValue,
+			NewEncoder::EncoderValue maxValue) {
+		return (value < maxValue) ? value + 1 : minValue;
+	}
+	static inline NewEncoder::EncoderValue decrement(NewEncoder::EncoderValue value, NewEncoder::EncoderValue minValue,
+			NewEncoder::EncoderValue maxValue) {
+		return (value > minValue) ? value - 1 : maxValue;
+	}
+};
+
+// Callback policies for NewEncoderT. onChange() is called in interrupt context after every detent.
+struct NoCallback {
+	static inline void onChange(const volatile NewEncoder::EncoderState&) {
+	}
+};
+
+// Compile-time specialized encoder. The pins, transition table, value policy, and callback policy are all
+// template parameters, so the ISRs are plain static functions: no trampoline, no object pointer, no virtual
+// updateValue(), and no indirect callback. The register addresses and bitmasks are resolved once by begin()
+// into static storage of this instantiation.
+//
+// All state is static. So, only one object may exist for a given A_PIN / B_PIN pair. With NEWENCODER_ATOMIC_STATE,
+// the state is published and read the same lock-free way as NewEncoder's, so the ISR may run on another core.
+// liveState, as passed to the callback policy, is then only the ISR's copy.
+template<uint8_t A_PIN, uint8_t B_PIN, uint8_t TYPE = FULL_PULSE, typename ValuePolicy = SaturateValue,
+		typename CallbackPolicy = NoCallback>
+class NewEncoderT {
+	static_assert(A_PIN != B_PIN, "A_PIN and B_PIN must be different");
+	static_assert((TYPE == FULL_PULSE) || (TYPE == HALF_PULSE), "TYPE must be FULL_PULSE or HALF_PULSE");
+
+public:
+	using EncoderValue = NewEncoder::EncoderValue;
+	using EncoderState = NewEncoder::EncoderState;
+
+	NewEncoderT(EncoderValue minValue, EncoderValue maxValue, EncoderValue initalValue) {
+		if (initalValue > maxValue) {
+			initalValue = maxValue;
+		} else if (initalValue < minValue) {
+			initalValue = minValue;
+		}
+		_minValue = minValue;
+		_maxValue = maxValue;
+		liveState.currentValue = initalValue;
+		liveState.currentClick = NewEncoder::NoClick;
+		localState.currentValue = initalValue;
+		stateChanged = false;
+#if NEWENCODER_ATOMIC_STATE
+		__atomic_store_n(&publishedState, NewEncoderAtomic::packState(initalValue, NewEncoder::NoClick, false), __ATOMIC_RELEASE);
+#endif
+	}
+
+	~NewEncoderT() {
+		end();
+	}
+
+	bool begin() {
+		if (active) {
+			return false;
+		}
+		if (_minValue >= _maxValue) {
+			return false;
+		}
+		if ((digitalPinToInterrupt(A_PIN) == NOT_AN_INTERRUPT) || (digitalPinToInterrupt(B_PIN) == NOT_AN_INTERRUPT)) {
+			return false;
+		}
+		// attachInterrupt() would silently take over an interrupt a NewEncoder uses. Claim both, so neither side can.
+		if (!NewEncoder::claimInterrupt(digitalPinToInterrupt(A_PIN))) {
+			return false;
+		}
+		if (!NewEncoder::claimInterrupt(digitalPinToInterrupt(B_PIN))) {
+			NewEncoder::releaseInterrupt(digitalPinToInterrupt(A_PIN));
+			return false;
+		}
+		_aPin_register = PIN_TO_BASEREG(A_PIN);
+		_bPin_register = PIN_TO_BASEREG(B_PIN);
+		_aPin_bitmask = PIN_TO_BITMASK(A_PIN);
+		_bPin_bitmask = PIN_TO_BITMASK(B_PIN);
+
+		pinMode(A_PIN, INPUT_PULLUP);
+		pinMode(B_PIN, INPUT_PULLUP);
+		delay(2);  // Seems to help ensure first reading after pinMode is correct
+		_aPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+		_bPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+		currentStateVariable = (_bPinValue << 1) | _aPinValue;
+		if ((TYPE == HALF_PULSE) && (currentStateVariable == 0b11)) {
+			currentStateVariable = 0b111;  // DETENT_1
+		}
+
+		attachInterrupt(digitalPinToInterrupt(A_PIN), aPinChange, CHANGE);
+		attachInterrupt(digitalPinToInterrupt(B_PIN), bPinChange, CHANGE);
+		active = true;
+		return true;
+	}
+
+	void end() {
+		if (!active) {
+			return;
+		}
+		active = false;
+		detachInterrupt(digitalPinToInterrupt(A_PIN));
+		detachInterrupt(digitalPinToInterrupt(B_PIN));
+		NewEncoder::releaseInterrupt(digitalPinToInterrupt(A_PIN));
+		NewEncoder::releaseInterrupt(digitalPinToInterrupt(B_PIN));
+	}
+
+	bool enabled() const {
+		return active;
+	}
+
+	bool getState(EncoderState &state) {
+#if NEWENCODER_ATOMIC_STATE
+		using namespace NewEncoderAtomic;
+		// Clear the changed flag only in the exact word that was read. Retry if the ISR published in between.
+		PackedState packed = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+		while ((packed & ATOMIC_CHANGED_BIT) != 0) {
+			if (__atomic_compare_exchange_n(&publishedState, &packed, packed & ~ATOMIC_CHANGED_BIT, false, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE)) {
+				break;
+			}
+		}
+		unpackState(packed, state);
+		return (packed & ATOMIC_CHANGED_BIT) != 0;
+#else
+		bool localStateChanged = stateChanged;
+		if (localStateChanged) {
+			noInterrupts();
+			memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+			stateChanged = false;
+			interrupts();
+		} else {
+			localState.currentClick = NewEncoder::NoClick;
+		}
+		memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
+		return localStateChanged;
+#endif
+	}
+
+	bool getAndSet(EncoderValue val, EncoderState &Oldstate, EncoderState &Newstate) {
+		bool changed;
+		if (val < _minValue) {
+			val = _minValue;
+		} else if (val > _maxValue) {
+			val = _maxValue;
+		}
+#if NEWENCODER_ATOMIC_STATE
+		using namespace NewEncoderAtomic;
+		PackedState packed = __atomic_exchange_n(&publishedState, packState(val, NewEncoder::NoClick, false), __ATOMIC_ACQ_REL);
+		unpackState(packed, Oldstate);
+		Newstate.currentValue = val;
+		Newstate.currentClick = NewEncoder::NoClick;
+		changed = (packed & ATOMIC_CHANGED_BIT) != 0;
+#else
+		noInterrupts();
+		changed = stateChanged;
+		stateChanged = false;
+		memcpy((void*) &Oldstate, (void*) &liveState, sizeof(EncoderState));
+		if (!changed) {
+			Oldstate.currentClick = NewEncoder::NoClick;
+		}
+		liveState.currentValue = val;
+		liveState.currentClick = NewEncoder::NoClick;
+		memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+		interrupts();
+		memcpy((void*) &Newstate, (void*) &localState, sizeof(EncoderState));
+#endif
+		return changed;
+	}
+
+	bool newSettings(EncoderValue newMin, EncoderValue newMax, EncoderValue newCurrent, EncoderState &state) {
+		if (newMax <= newMin) {
+			return false;
+		}
+		if (newCurrent < newMin) {
+			newCurrent = newMin;
+		}
+		if (newCurrent > newMax) {
+			newCurrent = newMax;
+		}
+#if NEWENCODER_ATOMIC_STATE
+		// Limits first, so an ISR that sees the new value also sees the new limits
+		_minValue = newMin;
+		_maxValue = newMax;
+		__atomic_store_n(&publishedState, NewEncoderAtomic::packState(newCurrent, NewEncoder::NoClick, false), __ATOMIC_RELEASE);
+		state.currentValue = newCurrent;
+		state.currentClick = NewEncoder::NoClick;
+#else
+		noInterrupts();
+		stateChanged = false;
+		liveState.currentValue = newCurrent;
+		liveState.currentClick = NewEncoder::NoClick;
+		_minValue = newMin;
+		_maxValue = newMax;
+		memcpy((void*) &localState, (void*) &liveState, sizeof(EncoderState));
+		interrupts();
+		memcpy((void*) &state, (void*) &localState, sizeof(EncoderState));
+#endif
+		return true;
+	}
+
+	NewEncoderT(const NewEncoderT&) = delete; // delete copy constructor. no copying allowed
+	NewEncoderT& operator=(const NewEncoderT&) = delete; // delete operator=(). no assignment allowed
+
+private:
+	static void ESP_ISR aPinChange() {
+		uint8_t newPinValue = DIRECT_PIN_READ(_aPin_register, _aPin_bitmask);
+		if (newPinValue == _aPinValue) {
+			return;
+		}
+		_aPinValue = newPinValue;
+		pinChangeHandler(0b00 | newPinValue);  // Falling aPin == 0b00, Rising aPin = 0b01;
+	}
+
+	static void ESP_ISR bPinChange() {
+		uint8_t newPinValue = DIRECT_PIN_READ(_bPin_register, _bPin_bitmask);
+		if (newPinValue == _bPinValue) {
+			return;
+		}
+		_bPinValue = newPinValue;
+		pinChangeHandler(0b10 | newPinValue);  // Falling bPin == 0b10, Rising bPin = 0b11;
+	}
+
+	static inline void pinChangeHandler(uint8_t index) {
+		const uint8_t newStateVariable = (TYPE == HALF_PULSE) ?
+				NEWENCODER_TABLE_READ(NewEncoder::halfPulseTransitionTable[currentStateVariable][index]) :
+				NEWENCODER_TABLE_READ(NewEncoder::fullPulseTransitionTable[currentStateVariable][index]);
+		currentStateVariable = newStateVariable & STATE_MASK;
+		const uint8_t delta = newStateVariable & DELTA_MASK;
+		if (delta == 0) {
+			return;
+		}
+#if NEWENCODER_ATOMIC_STATE
+		// Apply the policy to the published value and publish the result with one compare-and-swap. If another core
+		// changed the value in between (getAndSet(), newSettings()), the policy is applied again to the new value.
+		using namespace NewEncoderAtomic;
+		const NewEncoder::EncoderClick click = (delta == INCREMENT_DELTA) ? NewEncoder::UpClick : NewEncoder::DownClick;
+		PackedState expected = __atomic_load_n(&publishedState, __ATOMIC_ACQUIRE);
+		PackedState desired;
+		EncoderValue value;
+		do {
+			value = unpackValue(expected);
+			value = (delta == INCREMENT_DELTA) ?
+					ValuePolicy::increment(value, _minValue, _maxValue) : ValuePolicy::decrement(value, _minValue, _maxValue);
+			desired = packState(value, click, true);
+		} while (!__atomic_compare_exchange_n(&publishedState, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+		liveState.currentClick = click;
+		liveState.currentValue = value;
+#else
+		if (delta == INCREMENT_DELTA) {
+			liveState.currentClick = NewEncoder::UpClick;
+			liveState.currentValue = ValuePolicy::increment(liveState.currentValue, _minValue, _maxValue);
+		} else {
+			liveState.currentClick = NewEncoder::DownClick;
+			liveState.currentValue = ValuePolicy::decrement(liveState.currentValue, _minValue, _maxValue);
+		}
+		stateChanged = true;
+#endif
+		CallbackPolicy::onChange(liveState);
+	}
+
+	static volatile EncoderValue _minValue, _maxValue;
+	static volatile EncoderState liveState;
+	static volatile bool stateChanged;
+#if NEWENCODER_ATOMIC_STATE
+	static volatile uint32_t publishedState;  // currentValue, currentClick, and stateChanged packed
+#endif
+	static EncoderState localState;
+	static bool active;
+	static volatile uint8_t _aPinValue, _bPinValue;
+	static volatile uint8_t currentStateVariable;
+	static volatile IO_REG_TYPE *_aPin_register;
+	static volatile IO_REG_TYPE *_bPin_register;
+	static IO_REG_TYPE _aPin_bitmask;
+	static IO_REG_TYPE _bPin_bitmask;
+};
+
+#define NEWENCODERT_STATIC(type, name, init) \
+	template<uint8_t A_PIN, uint8_t B_PIN, uint8_t TYPE, typename ValuePolicy, typename CallbackPolicy> \
+	type NewEncoderT<A_PIN, B_PIN, TYPE, ValuePolicy, CallbackPolicy>::name init
+
+NEWENCODERT_STATIC(volatile NewEncoder::EncoderValue, _minValue, = 0);
+NEWENCODERT_STATIC(volatile NewEncoder::EncoderValue, _maxValue, = 0);
+NEWENCODERT_STATIC(volatile NewEncoder::EncoderState, liveState, );
+NEWENCODERT_STATIC(volatile bool, stateChanged, = false);
+#if NEWENCODER_ATOMIC_STATE
+NEWENCODERT_STATIC(volatile uint32_t, publishedState, = 0);
+#endif
+NEWENCODERT_STATIC(NewEncoder::EncoderState, localState, );
+NEWENCODERT_STATIC(bool, active, = false);
+NEWENCODERT_STATIC(volatile uint8_t, _aPinValue, = 0);
+NEWENCODERT_STATIC(volatile uint8_t, _bPinValue, = 0);
+NEWENCODERT_STATIC(volatile uint8_t, currentStateVariable, = 0);
+NEWENCODERT_STATIC(volatile IO_REG_TYPE *, _aPin_register, = nullptr);
+NEWENCODERT_STATIC(volatile IO_REG_TYPE *, _bPin_register, = nullptr);
+NEWENCODERT_STATIC(IO_REG_TYPE, _aPin_bitmask, );
+NEWENCODERT_STATIC(IO_REG_TYPE, _bPin_bitmask, );
+
+#undef NEWENCODERT_STATIC
+
+#endif /* NEWENCODERT_H_ */
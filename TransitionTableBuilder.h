@@ -0,0 +1,262 @@
+/*
+ * TransitionTableBuilder.h
+ */
+#ifndef TRANSITIONTABLEBUILDER_H_
+#define TRANSITIONTABLEBUILDER_H_
+
+#include "NewEncoder.h"
+
+// Quadrature positions are numbered in clockwise (incrementing) Gray-code order: position 0 = B/A 11, 1 = 10,
+// 2 = 00, 3 = 01. Step n is the move between position n and position n + 1 (mod 4).
+//
+// State codes follow the built-in tables: bits 1-0 are the B/A levels of the state's position (readPinState()
+// starts a custom table in the state whose code equals the pin levels), bit 2 tells the two states of the
+// same position apart.
+namespace TransitionTableDetail {
+constexpr uint8_t pinsOf(uint8_t position) {
+	return (position == 0) ? 0b11 : (position == 1) ? 0b10 : (position == 2) ? 0b00 : 0b01;
+}
+
+constexpr uint8_t positionOf(uint8_t pins) {
+	return (pins == 0b11) ? 0 : (pins == 0b10) ? 1 : (pins == 0b00) ? 2 : 3;
+}
+
+constexpr bool bit(uint8_t mask, uint8_t n) {
+	return ((mask >> n) & 1) != 0;
+}
+
+// B/A levels after the edge in table column 'index' (A_PIN_FALLING ... B_PIN_RISING)
+constexpr uint8_t applyEdge(uint8_t pins, uint8_t index) {
+	return (index & 0b10) ? ((pins & 0b01) | ((index & 1) << 1)) : ((pins & 0b10) | (index & 1));
+}
+
+// Table column of the edge that moves from 'pins' one step clockwise (direction > 0) or counter-clockwise
+constexpr uint8_t stepIndex(uint8_t pins, int8_t direction) {
+	return (((pins ^ pinsOf((positionOf(pins) + ((direction > 0) ? 1 : 3)) & 0b11)) & 0b01) != 0) ?
+			(0b00 | ((pins & 0b01) ^ 0b01)) : (0b10 | (((pins >> 1) & 0b01) ^ 0b01));
+}
+
+// ---- Pattern -> table ----
+
+constexpr uint8_t nextDetent(uint8_t detents, uint8_t position, uint8_t depth = 0) {
+	return (depth == 4) ? position :
+			bit(detents, (position + 1) & 0b11) ? static_cast<uint8_t>((position + 1) & 0b11) :
+					nextDetent(detents, (position + 1) & 0b11, depth + 1);
+}
+
+constexpr uint8_t previousDetent(uint8_t detents, uint8_t position, uint8_t depth = 0) {
+	return (depth == 4) ? position :
+			bit(detents, (position + 3) & 0b11) ? static_cast<uint8_t>((position + 3) & 0b11) :
+					previousDetent(detents, (position + 3) & 0b11, depth + 1);
+}
+
+// Count steps clockwise from 'step' until reaching position 'to'
+constexpr uint8_t countStepsBetween(uint8_t countSteps, uint8_t step, uint8_t to, uint8_t depth = 0) {
+	return (depth == 4) ? 0 :
+			static_cast<uint8_t>(bit(countSteps, step) + ((((step + 1) & 0b11) == to) ? 0 :
+					countStepsBetween(countSteps, (step + 1) & 0b11, to, depth + 1)));
+}
+
+// Count steps of the detent-to-detent segment that leaves 'detent' clockwise
+constexpr uint8_t segmentCount(uint8_t detents, uint8_t countSteps, uint8_t detent) {
+	return countStepsBetween(countSteps, detent, nextDetent(detents, detent));
+}
+
+constexpr uint8_t countDelta(bool count, int8_t direction) {
+	return count ? ((direction > 0) ? INCREMENT_DELTA : DECREMENT_DELTA) : 0;
+}
+
+// State code: position pins, plus bit 2 for a position that was reached counter-clockwise from its segment's detent
+constexpr uint8_t stateCode(uint8_t position, bool counterClockwise) {
+	return static_cast<uint8_t>((counterClockwise ? 0b100 : 0) | pinsOf(position));
+}
+
+constexpr bool validState(uint8_t detents, uint8_t state) {
+	return !bit(detents, positionOf(state & 0b11)) || ((state & 0b100) == 0);
+}
+
+// Entry for a move from 'position' to the adjacent 'newPosition'. 'counterClockwise' is the state's bit 2.
+constexpr uint8_t moveEntry(uint8_t detents, uint8_t countSteps, uint8_t position, bool counterClockwise,
+		uint8_t newPosition, int8_t direction) {
+	return bit(detents, newPosition) ?
+			// Arriving at a detent. Count if this completes a segment in the direction it was entered.
+			static_cast<uint8_t>(stateCode(newPosition, false) | (bit(detents, position) ?
+					countDelta(bit(countSteps, (direction > 0) ? position : newPosition), direction) :
+					((direction > 0) != counterClockwise) ?
+							countDelta(segmentCount(detents, countSteps, previousDetent(detents, position)) != 0, direction) :
+							0)) :
+			// Between detents. Leaving a detent picks the side. Otherwise it's kept, so bounce never counts.
+			stateCode(newPosition, bit(detents, position) ? (direction < 0) : counterClockwise);
+}
+
+constexpr uint8_t buildEntry(uint8_t detents, uint8_t countSteps, uint8_t state, uint8_t index) {
+	return !validState(detents, state) ?
+			// Unused code - resynchronize to the position's clockwise state
+			static_cast<uint8_t>((state & 0b11) | INVALID_TRANSITION) :
+			(applyEdge(state & 0b11, index) == (state & 0b11)) ? state :
+					moveEntry(detents, countSteps, positionOf(state & 0b11), (state & 0b100) != 0,
+							positionOf(applyEdge(state & 0b11, index)),
+							(positionOf(applyEdge(state & 0b11, index)) == ((positionOf(state & 0b11) + 1) & 0b11)) ? 1 : -1);
+}
+
+constexpr bool segmentsCountOnce(uint8_t detents, uint8_t countSteps, uint8_t detent = 0) {
+	return (detent == 4) ? true :
+			(!bit(detents, detent) || (segmentCount(detents, countSteps, detent) <= 1))
+					&& segmentsCountOnce(detents, countSteps, detent + 1);
+}
+
+constexpr uint8_t restStates(uint8_t detents, uint8_t position = 0) {
+	return (position == 4) ? 0 :
+			static_cast<uint8_t>((bit(detents, position) ? (1 << pinsOf(position)) : 0) | restStates(detents, position + 1));
+}
+
+// ---- Table checks ----
+
+using Table = NewEncoder::encoderStateTransition[8];
+
+constexpr uint8_t target(const Table &table, uint8_t state, uint8_t index) {
+	return table[state][index] & STATE_MASK;
+}
+
+constexpr uint8_t successors(const Table &table, uint8_t states, uint8_t state = 0) {
+	return (state == 8) ? 0 :
+			static_cast<uint8_t>((bit(states, state) ?
+					((1 << target(table, state, 0)) | (1 << target(table, state, 1)) | (1 << target(table, state, 2))
+							| (1 << target(table, state, 3))) : 0) | successors(table, states, state + 1));
+}
+
+// All states reachable from 'states' by any sequence of edges
+constexpr uint8_t reachable(const Table &table, uint8_t states, uint8_t rounds = 8) {
+	return (rounds == 0) ? states : reachable(table, static_cast<uint8_t>(states | successors(table, states)), rounds - 1);
+}
+
+// Every state, including unused codes, can get back to a rest state
+constexpr bool noStuckStates(const Table &table, uint8_t rest, uint8_t state = 0) {
+	return (state == 8) ? true :
+			((reachable(table, 1 << state) & rest) != 0) && noStuckStates(table, rest, state + 1);
+}
+
+// Every transition out of a reachable state goes to a state whose code holds the new pin levels, and none is invalid
+constexpr bool consistentTransitions(const Table &table, uint8_t states, uint8_t entry = 0) {
+	return (entry == 32) ? true :
+			(!bit(states, entry >> 2)
+					|| (((table[entry >> 2][entry & 0b11] & INVALID_TRANSITION) == 0)
+							&& ((table[entry >> 2][entry & 0b11] & 0b11) == applyEdge((entry >> 2) & 0b11, entry & 0b11))))
+					&& consistentTransitions(table, states, entry + 1);
+}
+
+struct Walk {
+	uint8_t state;
+	int8_t count;
+};
+
+constexpr int8_t entryCount(uint8_t entry) {
+	return ((entry & DELTA_MASK) == INCREMENT_DELTA) ? 1 : ((entry & DELTA_MASK) == DECREMENT_DELTA) ? -1 : 0;
+}
+
+constexpr Walk step(const Table &table, Walk walk, int8_t direction) {
+	return Walk { static_cast<uint8_t>(table[walk.state][stepIndex(walk.state & 0b11, direction)] & STATE_MASK),
+			static_cast<int8_t>(walk.count + entryCount(table[walk.state][stepIndex(walk.state & 0b11, direction)])) };
+}
+
+// Rotate 'steps' quadrature steps in one direction
+constexpr Walk rotate(const Table &table, Walk walk, int8_t direction, uint8_t steps) {
+	return (steps == 0) ? walk : rotate(table, step(table, walk, direction), direction, steps - 1);
+}
+
+constexpr bool sameWalk(Walk a, uint8_t state, int8_t count) {
+	return (a.state == state) && (a.count == count);
+}
+
+// From rest state 'state': k steps one way and k back (k = 1 ... 3) return to it with no net count, and a full
+// cycle either way returns to it with equal and opposite non-zero counts
+constexpr bool symmetricFrom(const Table &table, uint8_t state, uint8_t k = 1) {
+	return (k == 4) ?
+			((rotate(table, Walk { state, 0 }, 1, 4).state == state)
+					&& sameWalk(rotate(table, Walk { state, 0 }, -1, 4), state, static_cast<int8_t>(-rotate(table, Walk { state, 0 }, 1, 4).count))
+					&& (rotate(table, Walk { state, 0 }, 1, 4).count > 0)) :
+			sameWalk(rotate(table, rotate(table, Walk { state, 0 }, 1, k), -1, k), state, 0)
+					&& sameWalk(rotate(table, rotate(table, Walk { state, 0 }, -1, k), 1, k), state, 0)
+					&& symmetricFrom(table, state, k + 1);
+}
+
+constexpr bool symmetricCounting(const Table &table, uint8_t rest, uint8_t state = 0) {
+	return (state == 8) ? true : (!bit(rest, state) || symmetricFrom(table, state)) && symmetricCounting(table, rest, state + 1);
+}
+
+constexpr bool sameTables(const Table &a, const Table &b, uint8_t entry = 0) {
+	return (entry == 32) ? true :
+			(a[entry >> 2][entry & 0b11] == b[entry >> 2][entry & 0b11]) && sameTables(a, b, entry + 1);
+}
+} // namespace TransitionTableDetail
+
+// Checks a FULL_PULSE / HALF_PULSE style table (columns A_PIN_FALLING ... B_PIN_RISING). 'restStates' is the mask
+// of state codes the encoder rests in at a detent. The table passes if:
+//  - every rest state is reachable from the others
+//  - no state is stuck: a rest state can be reached from every one of the 8 codes, including unused ones
+//  - transitions out of reachable states are never invalid and always land in the state of the new pin levels
+//  - counting is symmetric: a full cycle counts +N clockwise and -N counter-clockwise (N > 0), and turning
+//    1 to 3 steps away from a detent and back counts nothing (bounce)
+constexpr bool isValidTransitionTable(const NewEncoder::encoderStateTransition (&table)[8], uint8_t restStates) {
+	return (restStates != 0)
+			&& ((TransitionTableDetail::reachable(table, restStates) & restStates) == restStates)
+			&& TransitionTableDetail::noStuckStates(table, restStates)
+			&& TransitionTableDetail::consistentTransitions(table, TransitionTableDetail::reachable(table, restStates))
+			&& TransitionTableDetail::symmetricCounting(table, restStates);
+}
+
+// Generates a transition table at compile time from a detent pattern:
+//  - DETENT_POSITIONS - bit n set: the encoder rests at position n (see above)
+//  - COUNT_STEPS - bit n set: passing step n counts (once the next detent is reached). Each detent-to-detent
+//    segment may hold at most one count step. Segments without one move between detents without counting.
+// Between detents, the state remembers which side it came from, so contact bounce and turning back never count.
+// Check a new pattern with static_assert(TransitionTableBuilder<...>::valid(), ...). The table is used with
+// NewEncoder::configure(..., TransitionTableBuilder<...>::table) exactly like the built-in tables.
+template<uint8_t DETENT_POSITIONS, uint8_t COUNT_STEPS>
+struct TransitionTableBuilder {
+	static_assert((DETENT_POSITIONS != 0) && (DETENT_POSITIONS <= 0b1111), "DETENT_POSITIONS must select 1 to 4 of positions 0 - 3");
+	static_assert((COUNT_STEPS != 0) && (COUNT_STEPS <= 0b1111), "COUNT_STEPS must select 1 to 4 of steps 0 - 3");
+	static_assert(TransitionTableDetail::segmentsCountOnce(DETENT_POSITIONS, COUNT_STEPS),
+			"Only one count step is allowed between two detents");
+
+	static constexpr uint8_t restStates = TransitionTableDetail::restStates(DETENT_POSITIONS);
+
+#define NEWENCODER_TABLE_ROW(state) { \
+		TransitionTableDetail::buildEntry(DETENT_POSITIONS, COUNT_STEPS, state, A_PIN_FALLING), \
+		TransitionTableDetail::buildEntry(DETENT_POSITIONS, COUNT_STEPS, state, A_PIN_RISING), \
+		TransitionTableDetail::buildEntry(DETENT_POSITIONS, COUNT_STEPS, state, B_PIN_FALLING), \
+		TransitionTableDetail::buildEntry(DETENT_POSITIONS, COUNT_STEPS, state, B_PIN_RISING) }
+
+	static constexpr NewEncoder::encoderStateTransition table[8] NEWENCODER_TABLE_ATTR = {
+			NEWENCODER_TABLE_ROW(0), NEWENCODER_TABLE_ROW(1), NEWENCODER_TABLE_ROW(2), NEWENCODER_TABLE_ROW(3),
+			NEWENCODER_TABLE_ROW(4), NEWENCODER_TABLE_ROW(5), NEWENCODER_TABLE_ROW(6), NEWENCODER_TABLE_ROW(7)
+	};
+
+#undef NEWENCODER_TABLE_ROW
+
+	static constexpr bool valid() {
+		return isValidTransitionTable(table, restStates);
+	}
+};
+
+template<uint8_t DETENT_POSITIONS, uint8_t COUNT_STEPS>
+constexpr NewEncoder::encoderStateTransition TransitionTableBuilder<DETENT_POSITIONS, COUNT_STEPS>::table[8] NEWENCODER_TABLE_ATTR;
+
+// Common detent patterns
+using FullPulseTable = TransitionTableBuilder<0b0001, 0b1000>;     // Rest at 11, count arriving from 01 - same as FULL_PULSE
+using HalfPulseTable = TransitionTableBuilder<0b0101, 0b1010>;     // Rest at 11 and 00 - behaves like HALF_PULSE
+using QuarterPulseTable = TransitionTableBuilder<0b1111, 0b1111>;  // Rest at every position, one count per edge
+
+static_assert(FullPulseTable::valid(), "FullPulseTable failed validation");
+static_assert(HalfPulseTable::valid(), "HalfPulseTable failed validation");
+static_assert(QuarterPulseTable::valid(), "QuarterPulseTable failed validation");
+
+// The generated FULL_PULSE table is the hand-written one, bit for bit. Both hand-written tables pass the checks.
+static_assert(TransitionTableDetail::sameTables(FullPulseTable::table, NewEncoder::fullPulseTransitionTable),
+		"FullPulseTable differs from fullPulseTransitionTable");
+static_assert(isValidTransitionTable(NewEncoder::fullPulseTransitionTable, 1 << 0b011),
+		"fullPulseTransitionTable failed validation");
+static_assert(isValidTransitionTable(NewEncoder::halfPulseTransitionTable, (1 << 0b000) | (1 << 0b111)),
+		"halfPulseTransitionTable failed validation");
+
+#endif /* TRANSITIONTABLEBUILDER_H_ */
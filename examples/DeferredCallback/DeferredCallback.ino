@@ -0,0 +1,60 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// The callback is invoked by NewEncoder::service() from loop(), not from the ISR. So, it may
+// take its time (e.g. print) without delaying the encoder interrupts.
+void callBack(NewEncoder *encPtr, const volatile NewEncoder::EncoderState *state, void *uPtr);
+
+// Pins 2 and 3 should work for many processors, including Uno. See README for meaning of constructor arguments.
+// Use FULL_PULSE for encoders that produce one complete quadrature pulse per detnet, such as: https://www.adafruit.com/product/377
+// Use HALF_PULSE for endoders that produce one complete quadrature pulse for every two detents, such as: https://www.mouser.com/ProductDetail/alps/ec11e15244g1/?qs=YMSFtX0bdJDiV4LBO61anw==&countrycode=US&currencycode=USD
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  } else {
+    encoder.getState(state);
+    Serial.print("Encoder Successfully Started at value = ");
+    Serial.println(state.currentValue);
+  }
+  if (!encoder.attachDeferredCallback(callBack)) {
+    Serial.println("No free deferred callback slot. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+}
+
+void loop() {
+  // Invokes the callback once for each encoder that changed since the last call
+  NewEncoder::service();
+}
+
+void callBack(NewEncoder *encPtr, const volatile NewEncoder::EncoderState *state, void *uPtr) {
+  (void) encPtr;
+  (void) uPtr;
+  Serial.print("Encoder: ");
+  Serial.print(state->currentValue);
+  switch (state->currentClick) {
+    case NewEncoder::UpClick:
+      Serial.println(" (up)");
+      break;
+
+    case NewEncoder::DownClick:
+      Serial.println(" (down)");
+      break;
+
+    default:
+      Serial.println();
+      break;
+  }
+}
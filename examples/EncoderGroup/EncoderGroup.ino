@@ -0,0 +1,52 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "NewEncoderGroup.h"
+
+// Adjust number of encoders and pin assignments for particular processor. These work for Teensy 3.2. See README for meaning of constructor arguments.
+// The group starts all encoders with one pin settle delay and reads all of their states in one critical section.
+NewEncoder encoders[] = {
+  { 0, 1, -20, 20, 0, FULL_PULSE },
+  { 20, 21, 0, 50, 25, FULL_PULSE },
+  { 5, 6, -25, 0, -13, FULL_PULSE },
+  { 11, 12, -10, 25, 8, FULL_PULSE }
+};
+
+const uint8_t numEncoders = sizeof(encoders) / sizeof(encoders[0]);
+NewEncoderGroup group;
+NewEncoder::EncoderState states[numEncoders];
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+
+  for (NewEncoder &encoder : encoders) {
+    group.add(encoder);
+  }
+  if (!group.begin()) {
+    Serial.println("Encoders Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  group.getStates(states);
+  for (uint8_t index = 0; index < numEncoders; index++) {
+    Serial.print("Encoder: ");
+    Serial.print(index);
+    Serial.print(" Successfully Started at value = ");
+    Serial.println(states[index].currentValue);
+  }
+}
+
+void loop() {
+  NewEncoderGroup::ChangedMask changed = group.getStates(states);
+  for (uint8_t index = 0; changed != 0; index++, changed >>= 1) {
+    if ((changed & 1) == 0) {
+      continue;  // Only touch the encoders that moved
+    }
+    Serial.print("Encoder ");
+    Serial.print(index);
+    Serial.print(": ");
+    Serial.println(states[index].currentValue);
+  }
+}
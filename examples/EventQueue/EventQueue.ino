@@ -0,0 +1,49 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// Demonstrate the optional event queue. Every detent is recorded by the ISR as a timestamped event,
+// so a busy loop() can catch up on fast spins without losing the direction history.
+
+// Pins 2 and 3 should work for many processors, including Uno. See README for meaning of constructor arguments.
+// Use FULL_PULSE for encoders that produce one complete quadrature pulse per detnet, such as: https://www.adafruit.com/product/377
+// Use HALF_PULSE for endoders that produce one complete quadrature pulse for every two detents, such as: https://www.mouser.com/ProductDetail/alps/ec11e15244g1/?qs=YMSFtX0bdJDiV4LBO61anw==&countrycode=US&currencycode=USD
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+NewEncoder::EventBuffer<16> encoderEvents;  // Size must be a power of 2
+uint32_t prevOverflows = 0;
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+
+  encoder.attachEventQueue(&encoderEvents);
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  Serial.println("Encoder Successfully Started");
+}
+
+void loop() {
+  NewEncoder::EncoderEvent events[4];
+  uint8_t count;
+
+  while ((count = encoder.readEvents(events, 4)) != 0) {
+    for (uint8_t i = 0; i < count; i++) {
+      Serial.print(events[i].timestamp);
+      Serial.print(events[i].delta > 0 ? " Up   " : " Down ");
+      Serial.println(events[i].value);
+    }
+  }
+
+  uint32_t overflows = encoder.getEventOverflows();
+  if (overflows != prevOverflows) {
+    Serial.print("Events lost: ");
+    Serial.println(overflows - prevOverflows);
+    prevOverflows = overflows;
+  }
+
+  delay(500);  // Simulate a busy loop
+}
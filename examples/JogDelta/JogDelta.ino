@@ -0,0 +1,34 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// Jog a position that has a much larger range than the encoder's value. readAndClearDelta() returns the
+// detents turned since the last call, even while the value is stuck at minValue or maxValue. So, loop()
+// can run slowly without losing motion.
+// Pins 2, 3 are used for the encoder. See README for meaning of constructor arguments.
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+int32_t position = 0;
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  Serial.println("Encoder Successfully Started");
+}
+
+void loop() {
+  int32_t delta = encoder.readAndClearDelta();
+  if (delta != 0) {
+    position += delta * 10L;  // 10 steps per detent
+    Serial.print("Jogged ");
+    Serial.print(delta);
+    Serial.print(" detents, position = ");
+    Serial.println(position);
+  }
+  delay(250);  // Slow poll rate. No detents are lost.
+}
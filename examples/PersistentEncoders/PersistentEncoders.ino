@@ -0,0 +1,70 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "NewEncoderStore.h"
+#include "NewEncoderEeprom.h"
+
+// Two encoders whose values survive a reset or power cycle. Changes are written to EEPROM once the
+// encoders have been still for a second (at most 10 s after a change), not on every detent. Each
+// record goes to the next slot in the first 256 bytes of EEPROM, spreading the wear.
+// Pins 2, 3 and 18, 19 are used for the encoders. See README for meaning of constructor arguments.
+NewEncoder volume;
+NewEncoder channel;
+NewEncoderEeprom eeprom(0, 256);
+NewEncoderStore store(eeprom, 2);
+NewEncoder::EncoderValue prevVolume, prevChannel;
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+#if defined(ESP8266) || defined(ESP32)
+  EEPROM.begin(256);
+#endif
+
+  if (store.restore()) {
+    Serial.println("Restored saved values");
+  }
+  volume.configure(2, 3, 0, 100, store.restoredValue(0, 50), FULL_PULSE);
+  channel.configure(18, 19, 1, 12, store.restoredValue(1, 1), FULL_PULSE);
+  if (!volume.begin() || !channel.begin()) {
+    Serial.println("Encoders Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  store.add(volume);
+  store.add(channel);
+  store.setUrgentMask(0b10);  // Save a channel change right away
+#if defined(__AVR__)
+  store.setChunkBytes(1);  // Each AVR EEPROM byte takes 3.3 ms. Don't stall loop() for a whole record.
+#endif
+
+  volume.getState(state);
+  prevVolume = state.currentValue;
+  channel.getState(state);
+  prevChannel = state.currentValue;
+  Serial.print("Volume = ");
+  Serial.print(prevVolume);
+  Serial.print(", Channel = ");
+  Serial.println(prevChannel);
+}
+
+void loop() {
+  NewEncoder::EncoderState state;
+
+  if (volume.getState(state) && (state.currentValue != prevVolume)) {
+    prevVolume = state.currentValue;
+    Serial.print("Volume = ");
+    Serial.println(prevVolume);
+  }
+  if (channel.getState(state) && (state.currentValue != prevChannel)) {
+    prevChannel = state.currentValue;
+    Serial.print("Channel = ");
+    Serial.println(prevChannel);
+  }
+  if (store.update()) {
+    Serial.println("Saved");
+  }
+}
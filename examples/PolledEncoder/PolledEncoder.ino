@@ -0,0 +1,54 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// The encoder's pins don't need to be interrupt-capable. They are sampled by NewEncoder::pollAll() from loop().
+// Keep loop() short - nothing else in it should take longer than the fast poll interval while the knob is turning.
+// See README for meaning of constructor arguments.
+NewEncoder encoder(4, 5, -20, 20, 0, FULL_PULSE);
+int16_t prevEncoderValue;
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+  if (!encoder.beginPolling()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  // Sample every 250us while turning, every 2ms after 100ms without a change
+  encoder.setPollIntervals(250, 2000, 100000);
+  encoder.getState(state);
+  Serial.print("Encoder Successfully Started at value = ");
+  prevEncoderValue = state.currentValue;
+  Serial.println(prevEncoderValue);
+}
+
+void loop() {
+  NewEncoder::EncoderState currentEncoderState;
+
+  NewEncoder::pollAll();
+  if (encoder.getState(currentEncoderState)) {
+    Serial.print("Encoder: ");
+    int16_t currentValue = currentEncoderState.currentValue;
+    if (currentValue != prevEncoderValue) {
+      Serial.println(currentValue);
+      prevEncoderValue = currentValue;
+    } else
+      switch (currentEncoderState.currentClick) {
+        case NewEncoder::UpClick:
+          Serial.println("at upper limit.");
+          break;
+
+        case NewEncoder::DownClick:
+          Serial.println("at lower limit.");
+          break;
+
+        default:
+          break;
+      }
+  }
+}
@@ -0,0 +1,57 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "NewEncoderPort.h"
+
+// Demonstrate decoding several encoders from a single port-change interrupt.
+// On an Uno, Arduino pins 0-7 are all on PORTD (PCINT2). Pins 0 and 1 are used by Serial, so this example
+// connects three encoders to pins 2/3, 4/5, and 6/7. None of them need an external-interrupt pin.
+
+#if !defined(__AVR__)
+#error This example uses the AVR pin-change interrupt vector. On other platforms, call port.portChange() from an interrupt on each encoder pin.
+#endif
+
+NewEncoder encoders[3];
+NewEncoderPort port;
+int16_t prevValues[3];
+
+ISR(PCINT2_vect) {
+  port.portChange();
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+
+  for (uint8_t i = 0; i < 3; i++) {
+    encoders[i].configure(2 + 2 * i, 3 + 2 * i, -20, 20, 0, FULL_PULSE);
+    if (!port.add(encoders[i])) {
+      Serial.println("Failed to add encoder to port. All pins must be on the same port. Aborting.");
+      while (1) {
+        yield();
+      }
+    }
+  }
+
+  if (!port.begin()) {
+    Serial.println("Port Failed to Start. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  Serial.println("Encoders Successfully Started");
+}
+
+void loop() {
+  NewEncoder::EncoderState state;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    if (encoders[i].getState(state) && (state.currentValue != prevValues[i])) {
+      Serial.print("Encoder ");
+      Serial.print(i);
+      Serial.print(": ");
+      Serial.println(state.currentValue);
+      prevValues[i] = state.currentValue;
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// If the encoder is unplugged or a wire breaks, a floating pin can fire its interrupt tens of thousands of times per
+// second. With storm protection, more than 100 interrupts in 10 ms detach the interrupts and the encoder is polled by
+// NewEncoder::serviceStorms() instead. Interrupts are re-attached once the pins have been still for 100 ms.
+// Pins 2, 3 are used for the encoder. See README for meaning of constructor arguments.
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+int16_t prevEncoderValue;
+bool prevStormActive = false;
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+  encoder.setStormProtection(100, 10000, 100000);
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  encoder.getState(state);
+  Serial.print("Encoder Successfully Started at value = ");
+  prevEncoderValue = state.currentValue;
+  Serial.println(prevEncoderValue);
+}
+
+void loop() {
+  NewEncoder::EncoderState currentEncoderState;
+
+  NewEncoder::serviceStorms();  // Polls the encoder during a storm and re-attaches its interrupts afterwards
+  if (encoder.getState(currentEncoderState)) {
+    int16_t currentValue = currentEncoderState.currentValue;
+    if (currentValue != prevEncoderValue) {
+      Serial.print("Encoder: ");
+      Serial.println(currentValue);
+      prevEncoderValue = currentValue;
+    }
+  }
+
+  bool stormActive = encoder.stormActive();
+  if (stormActive != prevStormActive) {
+    prevStormActive = stormActive;
+    if (stormActive) {
+      Serial.print("Interrupt storm - polling. Storms so far: ");
+      Serial.println(encoder.getStorms());
+    } else {
+      Serial.print("Line quiet - interrupts re-attached. Total time polled (ms): ");
+      Serial.println(encoder.getStormMillis());
+    }
+  }
+}
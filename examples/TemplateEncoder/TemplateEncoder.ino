@@ -0,0 +1,57 @@
+#include "Arduino.h"
+#include "NewEncoderT.h"
+
+// Demonstrate the compile-time specialized encoder. The pins, encoder type, value policy (WrapValue wraps around
+// at the limits like the CustomEncoder example), and callback policy are template parameters, so the ISRs are
+// straight-line code.
+
+struct CountDetents {
+  static volatile uint16_t detents;
+  static void onChange(const volatile NewEncoder::EncoderState &) {
+    detents++;
+  }
+};
+volatile uint16_t CountDetents::detents = 0;
+
+// Pins 2 and 3 should work for many processors, including Uno.
+// Use FULL_PULSE for encoders that produce one complete quadrature pulse per detnet, such as: https://www.adafruit.com/product/377
+// Use HALF_PULSE for endoders that produce one complete quadrature pulse for every two detents, such as: https://www.mouser.com/ProductDetail/alps/ec11e15244g1/?qs=YMSFtX0bdJDiV4LBO61anw==&countrycode=US&currencycode=USD
+NewEncoderT<2, 3, FULL_PULSE, WrapValue, CountDetents> encoder(0, 20, 10);
+int16_t prevEncoderValue;
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  } else {
+    encoder.getState(state);
+    Serial.print("Encoder Successfully Started at value = ");
+    prevEncoderValue = state.currentValue;
+    Serial.println(prevEncoderValue);
+  }
+}
+
+void loop() {
+  NewEncoder::EncoderState currentEncoderState;
+
+  if (encoder.getState(currentEncoderState)) {
+    if (currentEncoderState.currentValue != prevEncoderValue) {
+      prevEncoderValue = currentEncoderState.currentValue;
+      Serial.print("Encoder: ");
+      Serial.print(prevEncoderValue);
+      Serial.print("  Total detents: ");
+      noInterrupts();
+      uint16_t detents = CountDetents::detents;
+      interrupts();
+      Serial.println(detents);
+    }
+  }
+}
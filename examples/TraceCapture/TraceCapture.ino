@@ -0,0 +1,30 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// Records the raw pin changes seen by the encoder's ISRs. Send any character over Serial to get a binary dump
+// of the last 512 changes. Save it to a file with a serial terminal that can log raw bytes and replay it on a
+// PC with extras/host/TraceReplay.cpp to see how other encoder types or glitch filter settings would count it.
+// Pins 2, 3 are used for the encoder. See README for meaning of constructor arguments.
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+NewEncoder::TraceBuffer<512> trace;  // 4 bytes per record
+
+void setup() {
+  Serial.begin(115200);
+  delay(2000);
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  encoder.attachTrace(&trace);
+}
+
+void loop() {
+  if (Serial.available() > 0) {
+    while (Serial.available() > 0) {
+      Serial.read();
+    }
+    trace.dump(Serial);
+  }
+}
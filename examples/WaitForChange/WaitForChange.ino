@@ -0,0 +1,36 @@
+#include "Arduino.h"
+#include "NewEncoder.h"
+
+// Instead of calling getState() over and over, loop() waits for the encoder to move. On ESP32 the
+// task sleeps until the encoder's ISR wakes it. Other processors yield() while waiting.
+// Pins 2, 3 are used for the encoder. See README for meaning of constructor arguments.
+NewEncoder encoder(2, 3, -20, 20, 0, FULL_PULSE);
+
+void setup() {
+  NewEncoder::EncoderState state;
+
+  Serial.begin(115200);
+  delay(2000);
+  Serial.println("Starting");
+  if (!encoder.begin()) {
+    Serial.println("Encoder Failed to Start. Check pin assignments and available interrupts. Aborting.");
+    while (1) {
+      yield();
+    }
+  }
+  encoder.getState(state);
+  Serial.print("Encoder Successfully Started at value = ");
+  Serial.println(state.currentValue);
+}
+
+void loop() {
+  NewEncoder::EncoderState state;
+
+  // Any number of detents while this code was busy result in one wakeup with the latest value
+  if (encoder.waitForChange(state, 5000)) {
+    Serial.print("Encoder: ");
+    Serial.println(state.currentValue);
+  } else {
+    Serial.println("No change in 5 seconds");
+  }
+}
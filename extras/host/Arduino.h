@@ -0,0 +1,301 @@
+/*
+ * Arduino.h - Linux host stand-in for the Arduino core
+ *
+ * Provides just enough of the Arduino API for NewEncoder.cpp to build and run on a
+ * normal PC so the decoder can be exercised and benchmarked. The GPIO "hardware" is
+ * a fake register file of HOST_NUM_PORTS 32-bit input registers, pin n lives in
+ * port (n / 32) bit (n % 32). Pins 0 .. HOST_NUM_INTERRUPTS-1 are interrupt capable,
+ * the rest of the pins are not.
+ *
+ * Notification is a condition variable stand-in for an RTOS task notification, used by
+ * NewEncoder::waitForChange().
+ *
+ * Print is a minimal byte sink with the Arduino core's write() signatures.
+ *
+ * Time is simulated. micros() / millis() only move when the simulator (or delay())
+ * advances them. This keeps every run deterministic.
+ *
+ * Interrupts behave like a single-core MCU: while an ISR is running or interrupts are
+ * disabled, new requests are latched as pending and serviced (lowest number first)
+ * as soon as interrupts are enabled again.
+ *
+ * maskedMicros / maskPeriodMicros (0 by default) mask interrupts for maskedMicros at the
+ * start of every maskPeriodMicros of simulated time, as a long ISR or critical section of
+ * other code would. Requests made in that window are latched (a pin that changes twice
+ * still has one request) and serviced in priority order when the window ends.
+ *
+ * isrMicros (0 by default) is the simulated duration of every ISR. Interrupts stay blocked
+ * for that long after each ISR starts, so requests made meanwhile are latched the same way
+ * and edges closer together than an ISR can be coalesced or lost, as on hardware.
+ */
+#ifndef NEWENCODER_HOST_ARDUINO_H_
+#define NEWENCODER_HOST_ARDUINO_H_
+
+#define NEWENCODER_HOST
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define HOST_NUM_PORTS 2
+#define HOST_NUM_PINS (HOST_NUM_PORTS * 32)
+#define HOST_NUM_INTERRUPTS 48
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+// Flash-resident data on AVR (NEWENCODER_COMPACT). Plain memory here.
+#define PROGMEM
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+
+#define digitalPinToInterrupt(pin) ((pin) < HOST_NUM_INTERRUPTS ? (int)(pin) : NOT_AN_INTERRUPT)
+
+namespace HostHal {
+
+using IsrFunction = void (*)();
+
+inline volatile uint32_t portRegisters[HOST_NUM_PORTS];
+inline IsrFunction isrTable[HOST_NUM_INTERRUPTS];
+inline uint8_t pinModes[HOST_NUM_PINS];
+inline uint64_t pendingInterrupts = 0;
+inline bool interruptsEnabled = true;
+inline bool inIsr = false;
+inline uint64_t simulatedMicros = 0;
+inline uint32_t maskedMicros = 0;
+inline uint32_t maskPeriodMicros = 0;
+inline uint32_t isrMicros = 0;
+inline uint64_t busyUntil = 0;  // End of the (simulated) ISR that started last
+inline uint32_t interruptCounts[HOST_NUM_INTERRUPTS];  // ISR runs per interrupt number
+
+inline volatile uint32_t *pinToPortRegister(uint8_t pin) {
+	return &portRegisters[(pin >> 5) % HOST_NUM_PORTS];
+}
+
+inline uint32_t pinToBitMask(uint8_t pin) {
+	return 1UL << (pin & 0b11111);
+}
+
+inline uint8_t readPin(uint8_t pin) {
+	return (*pinToPortRegister(pin) & pinToBitMask(pin)) ? 1 : 0;
+}
+
+inline bool interruptsMasked() {
+	return ((maskPeriodMicros != 0) && ((simulatedMicros % maskPeriodMicros) < maskedMicros)) || (simulatedMicros < busyUntil);
+}
+// Run all latched interrupt requests, lowest interrupt number first (AVR priority order)
+inline void servicePendingInterrupts() {
+	while (interruptsEnabled && !inIsr && (pendingInterrupts != 0) && !interruptsMasked()) {
+		uint8_t intNumber = __builtin_ctzll(pendingInterrupts);
+		pendingInterrupts &= ~(1ULL << intNumber);
+		IsrFunction isr = isrTable[intNumber];
+		if (isr != nullptr) {
+			interruptCounts[intNumber]++;
+			inIsr = true;
+			isr();
+			inIsr = false;
+			busyUntil = simulatedMicros + isrMicros;
+		}
+	}
+}
+
+inline void requestInterrupt(uint8_t intNumber) {
+	if ((intNumber >= HOST_NUM_INTERRUPTS) || (isrTable[intNumber] == nullptr)) {
+		return;
+	}
+	pendingInterrupts |= 1ULL << intNumber;
+	servicePendingInterrupts();
+}
+
+// Drive a pin to a new level. If the level changes and the pin is interrupt capable,
+// the attached CHANGE interrupt is requested.
+inline void writePin(uint8_t pin, uint8_t level) {
+	volatile uint32_t *reg = pinToPortRegister(pin);
+	uint32_t mask = pinToBitMask(pin);
+	uint32_t oldValue = *reg;
+	uint32_t newValue = level ? (oldValue | mask) : (oldValue & ~mask);
+	if (newValue == oldValue) {
+		return;
+	}
+	*reg = newValue;
+	if (pin < HOST_NUM_INTERRUPTS) {
+		requestInterrupt(pin);
+	}
+}
+
+// Set pin levels without generating any interrupts (power-on state)
+inline void presetPin(uint8_t pin, uint8_t level) {
+	volatile uint32_t *reg = pinToPortRegister(pin);
+	if (level) {
+		*reg = *reg | pinToBitMask(pin);
+	} else {
+		*reg = *reg & ~pinToBitMask(pin);
+	}
+}
+
+// CPU time-stamp counter of the build machine (not simulated). Used for cycle measurements.
+inline uint64_t cycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+inline void advanceMicros(uint32_t us) {
+	uint64_t until = simulatedMicros + us;
+	while ((pendingInterrupts != 0) && interruptsMasked()) {
+		// Requests latched in a masked window or during an ISR are serviced when it ends
+		uint64_t unmasked = busyUntil;
+		if ((maskPeriodMicros != 0) && ((simulatedMicros % maskPeriodMicros) < maskedMicros)) {
+			uint64_t windowEnd = simulatedMicros - (simulatedMicros % maskPeriodMicros) + maskedMicros;
+			unmasked = (windowEnd > unmasked) ? windowEnd : unmasked;
+		}
+		if (unmasked > until) {
+			break;
+		}
+		simulatedMicros = unmasked;
+		servicePendingInterrupts();
+	}
+	simulatedMicros = until;
+}
+
+// Real time in milliseconds, the clock of Notification::take() timeouts
+inline uint32_t wallMillis() {
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Stand-in for an RTOS task notification. give() may be called from a simulated ISR on one thread,
+// take() blocks another thread until a give() or the (real time) timeout. Gives before a take() are coalesced.
+class Notification {
+public:
+	void give() {
+		std::lock_guard<std::mutex> lock(mutex);
+		given = true;
+		condition.notify_one();
+	}
+
+	bool take(uint32_t timeoutMillis) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if (timeoutMillis == 0xFFFFFFFFUL) {
+			condition.wait(lock, [this] {
+				return given;
+			});
+		} else if (!condition.wait_for(lock, std::chrono::milliseconds(timeoutMillis), [this] {
+			return given;
+		})) {
+			return false;
+		}
+		given = false;
+		return true;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool given = false;
+};
+
+inline void reset() {
+	for (auto &reg : portRegisters) {
+		reg = 0xFFFFFFFF;
+	}
+	for (auto &isr : isrTable) {
+		isr = nullptr;
+	}
+	for (auto &count : interruptCounts) {
+		count = 0;
+	}
+	pendingInterrupts = 0;
+	interruptsEnabled = true;
+	inIsr = false;
+	simulatedMicros = 0;
+	maskedMicros = 0;
+	maskPeriodMicros = 0;
+	isrMicros = 0;
+	busyUntil = 0;
+}
+
+} // namespace HostHal
+
+inline void noInterrupts() {
+	HostHal::interruptsEnabled = false;
+}
+
+inline void interrupts() {
+	HostHal::interruptsEnabled = true;
+	HostHal::servicePendingInterrupts();
+}
+
+inline void attachInterrupt(uint8_t intNumber, HostHal::IsrFunction isr, int mode) {
+	(void) mode;
+	if (intNumber < HOST_NUM_INTERRUPTS) {
+		HostHal::isrTable[intNumber] = isr;
+	}
+}
+
+inline void detachInterrupt(uint8_t intNumber) {
+	if (intNumber < HOST_NUM_INTERRUPTS) {
+		HostHal::isrTable[intNumber] = nullptr;
+		HostHal::pendingInterrupts &= ~(1ULL << intNumber);
+	}
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+	if (pin < HOST_NUM_PINS) {
+		HostHal::pinModes[pin] = mode;
+	}
+}
+
+inline int digitalRead(uint8_t pin) {
+	return HostHal::readPin(pin);
+}
+
+inline uint32_t micros() {
+	return static_cast<uint32_t>(HostHal::simulatedMicros);
+}
+
+inline uint32_t millis() {
+	return static_cast<uint32_t>(HostHal::simulatedMicros / 1000);
+}
+
+inline void delay(uint32_t ms) {
+	HostHal::advanceMicros(ms * 1000UL);
+}
+
+inline void delayMicroseconds(uint32_t us) {
+	HostHal::advanceMicros(us);
+}
+
+inline void yield() {
+}
+
+// Byte sink, e.g. for NewEncoder::TraceRing::dump()
+class Print {
+public:
+	virtual ~Print() {
+	}
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		size_t count = 0;
+		while (size-- != 0) {
+			count += write(*buffer++);
+		}
+		return count;
+	}
+};
+
+#endif /* NEWENCODER_HOST_ARDUINO_H_ */
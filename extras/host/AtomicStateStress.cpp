@@ -0,0 +1,273 @@
+/*
+ * AtomicStateStress.cpp - multi-threaded stress test of NEWENCODER_ATOMIC_STATE
+ *
+ * One producer thread plays the role of the core that services the encoder's interrupts:
+ * it drives the simulator, so aPinChange() / bPinChange() / pinChangeHandler() run on that
+ * thread. Consumer threads play the role of application code on other cores and only call
+ * the public state functions, which in atomic mode never touch noInterrupts() / interrupts().
+ *
+ *   - Conservation: the producer rotates clockwise only; consumers drain the value with
+ *     getAndSet(0). Drained total + final value must equal the number of detents.
+ *   - Torn reads: the producer alternates one detent up, one detent down, starting at 0.
+ *     Every changed state a consumer sees must be { 1, UpClick } or { 0, DownClick }.
+ *   - Delta: the encoder's limits are -5 / 5, so the value saturates, and one consumer keeps resetting
+ *     it with getAndSet(0). The other consumers drain readAndClearDelta(). Drained total + final
+ *     delta must equal the net detents turned.
+ *   - Stats (when built with NEWENCODER_STATS=1): consumers call getStats() while the producer
+ *     runs a bouncy stream. Each ISR is one edge, one no-op edge, or one filtered edge and records
+ *     one ISR duration, so every snapshot must have edges + noOpEdges + filteredEdges == sum of the
+ *     ISR histogram.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+#if !NEWENCODER_ATOMIC_STATE
+#error "Build with -DNEWENCODER_ATOMIC_STATE=1"
+#endif
+
+namespace {
+
+constexpr uint8_t aPin = 2;
+constexpr uint8_t bPin = 3;
+constexpr uint8_t numConsumers = 3;
+constexpr int32_t detentsPerTest = 2000000;
+
+bool conservationTest() {
+	NewEncoder encoder(aPin, bPin, -32000, 32000, 0, FULL_PULSE);
+	EncoderSimulator simulator(aPin, bPin);
+	std::atomic<bool> done(false);
+	std::atomic<int64_t> drained(0);
+
+	HostHal::reset();
+	simulator.reset();
+	if (!encoder.begin()) {
+		printf("conservation: begin() failed\n");
+		return false;
+	}
+
+	std::vector<std::thread> consumers;
+	for (uint8_t i = 0; i < numConsumers; i++) {
+		consumers.emplace_back([&] {
+			NewEncoder::EncoderState oldState, newState;
+			int64_t total = 0;
+			while (!done.load()) {
+				encoder.getAndSet(0, oldState, newState);
+				total += oldState.currentValue;
+			}
+			drained += total;
+		});
+	}
+
+	std::thread producer([&] {
+		NewEncoder::EncoderState state;
+		for (int32_t i = 0; i < detentsPerTest; i++) {
+			// Keep well away from maxValue so no detent is lost to clamping while the consumers are descheduled
+			do {
+				encoder.getState(state);
+			} while (state.currentValue > 16000);
+			simulator.rotate(1, EncoderSimulator::veryFast);
+		}
+	});
+
+	producer.join();
+	done = true;
+	for (std::thread &consumer : consumers) {
+		consumer.join();
+	}
+
+	NewEncoder::EncoderState oldState, newState;
+	encoder.getAndSet(0, oldState, newState);
+	int64_t total = drained + oldState.currentValue;
+	encoder.end();
+	printf("conservation: %d detents, %lld drained by %u consumers -> %s\n", detentsPerTest,
+			static_cast<long long>(total), numConsumers, (total == detentsPerTest) ? "OK" : "FAIL");
+	return total == detentsPerTest;
+}
+
+bool tornReadTest() {
+	NewEncoder encoder(aPin, bPin, -100, 100, 0, FULL_PULSE);
+	EncoderSimulator simulator(aPin, bPin);
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> observed(0);
+	std::atomic<uint64_t> torn(0);
+
+	HostHal::reset();
+	simulator.reset();
+	if (!encoder.begin()) {
+		printf("torn reads: begin() failed\n");
+		return false;
+	}
+
+	std::vector<std::thread> consumers;
+	for (uint8_t i = 0; i < numConsumers; i++) {
+		consumers.emplace_back([&] {
+			NewEncoder::EncoderState state;
+			uint64_t localObserved = 0, localTorn = 0;
+			while (!done.load()) {
+				if (encoder.getState(state)) {
+					localObserved++;
+					bool consistent = ((state.currentValue == 1) && (state.currentClick == NewEncoder::UpClick))
+							|| ((state.currentValue == 0) && (state.currentClick == NewEncoder::DownClick));
+					if (!consistent) {
+						localTorn++;
+					}
+				} else if ((state.currentValue != 0) && (state.currentValue != 1)) {
+					localTorn++;
+				}
+			}
+			observed += localObserved;
+			torn += localTorn;
+		});
+	}
+
+	std::thread producer([&] {
+		for (int32_t i = 0; i < detentsPerTest; i++) {
+			simulator.rotate((i & 1) ? -1 : 1, EncoderSimulator::veryFast);
+			if ((i & 0xFF) == 0) {
+				std::this_thread::yield();  // Give the consumers a chance to run on single-core hosts
+			}
+		}
+	});
+
+	producer.join();
+	done = true;
+	for (std::thread &consumer : consumers) {
+		consumer.join();
+	}
+	encoder.end();
+	printf("torn reads: %llu changed states observed, %llu inconsistent -> %s\n",
+			static_cast<unsigned long long>(observed.load()), static_cast<unsigned long long>(torn.load()),
+			(torn == 0) ? "OK" : "FAIL");
+	return torn == 0;
+}
+
+bool deltaTest() {
+	NewEncoder encoder(aPin, bPin, -5, 5, 0, FULL_PULSE);
+	EncoderSimulator simulator(aPin, bPin);
+	std::atomic<bool> done(false);
+	std::atomic<int64_t> drained(0);
+	int64_t turned = 0;
+
+	HostHal::reset();
+	simulator.reset();
+	if (!encoder.begin()) {
+		printf("delta: begin() failed\n");
+		return false;
+	}
+
+	std::vector<std::thread> consumers;
+	consumers.emplace_back([&] {
+		NewEncoder::EncoderState oldState, newState;
+		while (!done.load()) {
+			encoder.getAndSet(0, oldState, newState);
+		}
+	});
+	for (uint8_t i = 1; i < numConsumers; i++) {
+		consumers.emplace_back([&] {
+			int64_t total = 0;
+			while (!done.load()) {
+				total += encoder.readAndClearDelta();
+			}
+			drained += total;
+		});
+	}
+
+	std::thread producer([&] {
+		for (int32_t i = 0; i < detentsPerTest / 16; i++) {
+			int32_t cycles = (i % 3 == 0) ? -16 : 16;  // Net clockwise, far past maxValue
+			simulator.rotate(cycles, EncoderSimulator::veryFast);
+			turned += cycles;
+			if ((i & 0xF) == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	producer.join();
+	done = true;
+	for (std::thread &consumer : consumers) {
+		consumer.join();
+	}
+
+	int64_t total = drained + encoder.readAndClearDelta();
+	encoder.end();
+	printf("delta: %lld net detents, %lld drained -> %s\n", static_cast<long long>(turned), static_cast<long long>(total),
+			(total == turned) ? "OK" : "FAIL");
+	return total == turned;
+}
+
+#if NEWENCODER_STATS
+bool statsTest() {
+	NewEncoder encoder(aPin, bPin, -100, 100, 0, FULL_PULSE);
+	EncoderSimulator simulator(aPin, bPin);
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> snapshots(0);
+	std::atomic<uint64_t> torn(0);
+
+	HostHal::reset();
+	simulator.reset();
+	if (!encoder.begin()) {
+		printf("stats: begin() failed\n");
+		return false;
+	}
+
+	std::vector<std::thread> consumers;
+	for (uint8_t i = 0; i < numConsumers; i++) {
+		consumers.emplace_back([&] {
+			NewEncoder::EncoderStats stats;
+			uint64_t localSnapshots = 0, localTorn = 0;
+			while (!done.load()) {
+				encoder.getStats(stats);
+				uint32_t isrCount = 0;
+				for (uint8_t bucket = 0; bucket < NEWENCODER_STATS_BUCKETS; bucket++) {
+					isrCount += stats.isrHistogram[bucket];
+				}
+				localSnapshots++;
+				if (stats.edges + stats.noOpEdges + stats.filteredEdges != isrCount) {
+					localTorn++;
+				}
+			}
+			snapshots += localSnapshots;
+			torn += localTorn;
+		});
+	}
+
+	std::thread producer([&] {
+		for (int32_t i = 0; i < detentsPerTest / 10; i++) {
+			simulator.rotate((i & 1) ? -1 : 1, EncoderSimulator::bouncy);
+			if ((i & 0x3F) == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	producer.join();
+	done = true;
+	for (std::thread &consumer : consumers) {
+		consumer.join();
+	}
+	encoder.end();
+	printf("stats: %llu snapshots, %llu inconsistent -> %s\n", static_cast<unsigned long long>(snapshots.load()),
+			static_cast<unsigned long long>(torn.load()), (torn == 0) ? "OK" : "FAIL");
+	return torn == 0;
+}
+#endif
+
+} // namespace
+
+int main() {
+	bool passed = conservationTest();
+	passed = tornReadTest() && passed;
+	passed = deltaTest() && passed;
+#if NEWENCODER_STATS
+	passed = statsTest() && passed;
+#endif
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/*
+ * BitSlicedBenchmark.cpp - equivalence check and speed comparison of BitSlicedDecoder
+ * against the scalar transition-table walk
+ *
+ * The equivalence check runs first and covers every (state, pin, level) transition of
+ * both tables in every lane, then a long random edge stream on all lanes. The benchmark
+ * then reports the cost of decoding one port sample for 8, 16, and 32 encoders.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include "Arduino.h"
+#include "BitSlicedDecoder.h"
+
+namespace {
+
+// Reference: NewEncoder::pinChangeHandler's table walk, one encoder per lane
+template<uint8_t TYPE>
+struct ScalarDecoder {
+	const NewEncoder::encoderStateTransition *table =
+			(TYPE == HALF_PULSE) ? NewEncoder::halfPulseTransitionTable : NewEncoder::fullPulseTransitionTable;
+	uint8_t state[32];
+	uint8_t aValue[32];
+	uint8_t bValue[32];
+	uint8_t numLanes;
+
+	void reset(uint32_t aLevels, uint32_t bLevels, uint8_t lanes) {
+		numLanes = lanes;
+		for (uint8_t lane = 0; lane < numLanes; lane++) {
+			aValue[lane] = (aLevels >> lane) & 1;
+			bValue[lane] = (bLevels >> lane) & 1;
+			state[lane] = (bValue[lane] << 1) | aValue[lane];
+			if ((TYPE == HALF_PULSE) && (state[lane] == 0b11)) {
+				state[lane] = 0b111;
+			}
+		}
+	}
+
+	void step(uint32_t aLevels, uint32_t bLevels, uint32_t &incrementMask, uint32_t &decrementMask) {
+		incrementMask = 0;
+		decrementMask = 0;
+		for (uint8_t lane = 0; lane < numLanes; lane++) {
+			uint8_t a = (aLevels >> lane) & 1;
+			uint8_t b = (bLevels >> lane) & 1;
+			if (a != aValue[lane]) {
+				aValue[lane] = a;
+				apply(lane, 0b00 | a, incrementMask, decrementMask);
+			}
+			if (b != bValue[lane]) {
+				bValue[lane] = b;
+				apply(lane, 0b10 | b, incrementMask, decrementMask);
+			}
+		}
+	}
+
+	void apply(uint8_t lane, uint8_t index, uint32_t &incrementMask, uint32_t &decrementMask) {
+		uint8_t newState = table[state[lane]][index];
+		state[lane] = newState & STATE_MASK;
+		if ((newState & DELTA_MASK) == INCREMENT_DELTA) {
+			incrementMask |= 1UL << lane;
+		} else if ((newState & DELTA_MASK) == DECREMENT_DELTA) {
+			decrementMask |= 1UL << lane;
+		}
+	}
+};
+
+struct Sample {
+	uint32_t a;
+	uint32_t b;
+};
+
+// Random port samples. Each sample moves a random subset of lanes one Gray-code step (or bounces them).
+std::vector<Sample> makeSamples(size_t count, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::vector<Sample> samples;
+	uint32_t a = 0xFFFFFFFF, b = 0xFFFFFFFF;
+	samples.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t moving = rng() & rng();
+		uint32_t pinSelect = rng();
+		a ^= moving & pinSelect;
+		b ^= moving & ~pinSelect;
+		samples.push_back({ a, b });
+	}
+	return samples;
+}
+
+template<uint8_t TYPE>
+bool checkEquivalence(const char *typeName) {
+	const NewEncoder::encoderStateTransition *table =
+			(TYPE == HALF_PULSE) ? NewEncoder::halfPulseTransitionTable : NewEncoder::fullPulseTransitionTable;
+	BitSlicedDecoder<uint32_t, TYPE> sliced;
+
+	// Every table entry, in every lane
+	for (uint8_t state = 0; state < 8; state++) {
+		for (uint8_t index = 0; index < 4; index++) {
+			uint8_t level = index & 1;
+			uint32_t oldLevels = level ? 0 : 0xFFFFFFFF;
+			uint32_t newLevels = level ? 0xFFFFFFFF : 0;
+			uint32_t increments, decrements;
+			sliced.reset(oldLevels, oldLevels);
+			for (uint8_t lane = 0; lane < 32; lane++) {
+				sliced.setState(lane, state);
+			}
+			if (index & 0b10) {
+				sliced.step(oldLevels, newLevels, increments, decrements);
+			} else {
+				sliced.step(newLevels, oldLevels, increments, decrements);
+			}
+			uint8_t expected = table[state][index];
+			for (uint8_t lane = 0; lane < 32; lane++) {
+				bool increment = (increments >> lane) & 1;
+				bool decrement = (decrements >> lane) & 1;
+				if ((sliced.state(lane) != (expected & STATE_MASK))
+						|| (increment != ((expected & DELTA_MASK) == INCREMENT_DELTA))
+						|| (decrement != ((expected & DELTA_MASK) == DECREMENT_DELTA))) {
+					printf("%s: mismatch state %u index %u lane %u\n", typeName, state, index, lane);
+					return false;
+				}
+			}
+		}
+	}
+
+	// Long random stream on all lanes
+	ScalarDecoder<TYPE> scalar;
+	scalar.reset(0xFFFFFFFF, 0xFFFFFFFF, 32);
+	sliced.reset(0xFFFFFFFF, 0xFFFFFFFF);
+	for (const Sample &sample : makeSamples(1000000, 12345)) {
+		uint32_t scalarIncrements, scalarDecrements, slicedIncrements, slicedDecrements;
+		scalar.step(sample.a, sample.b, scalarIncrements, scalarDecrements);
+		sliced.step(sample.a, sample.b, slicedIncrements, slicedDecrements);
+		if ((scalarIncrements != slicedIncrements) || (scalarDecrements != slicedDecrements)) {
+			printf("%s: random stream mismatch\n", typeName);
+			return false;
+		}
+	}
+	printf("%s: bit-sliced decoder matches transition table\n", typeName);
+	return true;
+}
+
+template<typename Decoder, typename Word>
+void timeDecoder(Decoder &decoder, const std::vector<Sample> &samples, Word laneMask, const char *name, uint8_t lanes) {
+	uint32_t checksum = 0;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t startCycles = HostHal::cycleCount();
+	for (const Sample &sample : samples) {
+		Word increments, decrements;
+		decoder.step(static_cast<Word>(sample.a & laneMask), static_cast<Word>(sample.b & laneMask), increments, decrements);
+		checksum += increments - decrements;
+	}
+	uint64_t cycles = HostHal::cycleCount() - startCycles;
+	auto stop = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(stop - start).count() / samples.size();
+	printf("%-10s  %5u  %12.2f  %12.2f  (checksum %08x)\n", name, lanes, ns, static_cast<double>(cycles) / samples.size(),
+			checksum);
+}
+
+template<typename Word>
+void benchmark(const std::vector<Sample> &samples) {
+	constexpr uint8_t lanes = 8 * sizeof(Word);
+	const uint32_t laneMask = (lanes == 32) ? 0xFFFFFFFF : ((1UL << lanes) - 1);
+
+	ScalarDecoder<FULL_PULSE> scalar;
+	scalar.reset(laneMask, laneMask, lanes);
+	timeDecoder<ScalarDecoder<FULL_PULSE>, uint32_t>(scalar, samples, laneMask, "scalar", lanes);
+
+	BitSlicedDecoder<Word, FULL_PULSE> sliced;
+	sliced.reset(static_cast<Word>(laneMask), static_cast<Word>(laneMask));
+	timeDecoder<BitSlicedDecoder<Word, FULL_PULSE>, Word>(sliced, samples, static_cast<Word>(laneMask), "bit-sliced", lanes);
+}
+
+} // namespace
+
+int main() {
+	if (!checkEquivalence<FULL_PULSE>("FULL_PULSE") || !checkEquivalence<HALF_PULSE>("HALF_PULSE")) {
+		return 1;
+	}
+
+	std::vector<Sample> samples = makeSamples(4000000, 54321);
+	printf("\n%-10s  %5s  %12s  %12s\n", "decoder", "lanes", "ns/sample", "cycles/sample");
+	benchmark<uint8_t>(samples);
+	benchmark<uint16_t>(samples);
+	benchmark<uint32_t>(samples);
+	return 0;
+}
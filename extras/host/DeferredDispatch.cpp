@@ -0,0 +1,141 @@
+/*
+ * DeferredDispatch.cpp - host event loop for deferred callback dispatch
+ *
+ * Four encoders are rotated in random bursts. Between bursts the event loop calls
+ * NewEncoder::service(), the same way a sketch's loop() would. Checks:
+ *   - no deferred callback ever runs in (simulated) interrupt context
+ *   - after service(), the last state each callback saw equals the encoder's value
+ *   - detents between two service() calls are coalesced into at most one callback
+ * Then compares the ISR cost per edge of a slow callback run directly in the ISR and
+ * the same callback deferred to the event loop.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint8_t numEncoders = 4;
+constexpr uint32_t numBursts = 200000;
+
+struct CallbackRecord {
+	uint32_t calls = 0;
+	uint32_t callsInIsr = 0;
+	NewEncoder::EncoderValue lastValue = 0;
+};
+
+void recordCallback(NewEncoder *encoder, const volatile NewEncoder::EncoderState *state, void *userPointer) {
+	(void) encoder;
+	CallbackRecord *record = static_cast<CallbackRecord*>(userPointer);
+	record->calls++;
+	if (HostHal::inIsr) {
+		record->callsInIsr++;
+	}
+	record->lastValue = state->currentValue;
+}
+
+// Stand-in for logging / queue posting
+void slowCallback(NewEncoder *encoder, const volatile NewEncoder::EncoderState *state, void *userPointer) {
+	(void) encoder;
+	(void) state;
+	volatile uint32_t *sink = static_cast<volatile uint32_t*>(userPointer);
+	for (uint32_t i = 0; i < 2000; i++) {
+		*sink = *sink + i;
+	}
+}
+
+bool eventLoopTest() {
+	NewEncoder encoders[numEncoders];
+	EncoderSimulator *simulators[numEncoders];
+	CallbackRecord records[numEncoders];
+	uint32_t detents[numEncoders] = { };
+	uint32_t multiDetentServices = 0;
+	std::mt19937 rng(2024);
+
+	HostHal::reset();
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		simulators[i] = new EncoderSimulator(2 + 2 * i, 3 + 2 * i);
+		simulators[i]->reset();
+		encoders[i].configure(2 + 2 * i, 3 + 2 * i, -1000, 1000, 0, FULL_PULSE);
+		if (!encoders[i].begin() || !encoders[i].attachDeferredCallback(recordCallback, &records[i])) {
+			printf("setup failed\n");
+			return false;
+		}
+	}
+
+	bool passed = true;
+	for (uint32_t burst = 0; burst < numBursts; burst++) {
+		uint8_t moved = rng() % numEncoders;
+		int32_t cycles = static_cast<int32_t>(rng() % 5) - 2;
+		uint32_t callsBefore = records[moved].calls;
+		simulators[moved]->rotate(cycles, EncoderSimulator::clean);
+		detents[moved] += (cycles >= 0) ? cycles : -cycles;
+
+		NewEncoder::service();
+		if (records[moved].calls - callsBefore > 1) {
+			passed = false;  // Not coalesced
+		}
+		if ((cycles > 1) || (cycles < -1)) {
+			multiDetentServices++;
+		}
+		for (uint8_t i = 0; i < numEncoders; i++) {
+			NewEncoder::EncoderState state;
+			encoders[i].getState(state);
+			if ((records[i].calls != 0) && (records[i].lastValue != state.currentValue)) {
+				passed = false;
+			}
+		}
+	}
+
+	uint32_t totalDetents = 0, totalCalls = 0, callsInIsr = 0;
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		totalDetents += detents[i];
+		totalCalls += records[i].calls;
+		callsInIsr += records[i].callsInIsr;
+		encoders[i].end();
+		delete simulators[i];
+	}
+	passed = passed && (callsInIsr == 0);
+	printf("event loop: %lu detents, %lu callbacks (%lu bursts coalesced), %lu in ISR -> %s\n",
+			static_cast<unsigned long>(totalDetents), static_cast<unsigned long>(totalCalls),
+			static_cast<unsigned long>(multiDetentServices), static_cast<unsigned long>(callsInIsr), passed ? "OK" : "FAIL");
+	return passed;
+}
+
+// Cycles per edge spent inside the simulated interrupts, with the slow callback direct or deferred
+double isrCyclesPerEdge(bool deferred) {
+	volatile uint32_t sink = 0;
+	HostHal::reset();
+	EncoderSimulator simulator(2, 3);
+	simulator.reset();
+	NewEncoder encoder(2, 3, -30000, 30000, 0, FULL_PULSE);
+	encoder.begin();
+	if (deferred) {
+		encoder.attachDeferredCallback(slowCallback, (void*) &sink);
+	} else {
+		encoder.attachCallback(slowCallback, (void*) &sink);
+	}
+
+	uint64_t isrCycles = 0;
+	for (uint32_t burst = 0; burst < 2000; burst++) {
+		uint64_t start = HostHal::cycleCount();
+		simulator.rotate((burst & 1) ? -4 : 4, EncoderSimulator::veryFast);
+		isrCycles += HostHal::cycleCount() - start;
+		NewEncoder::service();
+	}
+	encoder.end();
+	return static_cast<double>(isrCycles) / simulator.edgeCount();
+}
+
+} // namespace
+
+int main() {
+	bool passed = eventLoopTest();
+	printf("slow callback, ISR cycles per edge: direct %.1f, deferred %.1f\n", isrCyclesPerEdge(false),
+			isrCyclesPerEdge(true));
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,543 @@
+/*
+ * EncoderBenchmark.cpp - host-side throughput / accuracy benchmark for NewEncoder
+ *
+ * Drives simulated quadrature streams through the real interrupt path
+ * (interrupt trampoline -> aPinChange / bPinChange -> pinChangeHandler) and reports,
+ * for each encoder type and edge profile:
+ *   - edges/s handled
+ *   - ns per edge spent in the encoder (simulator overhead subtracted)
+ *   - detents lost compared to the ideal count, with every ISR taking isrMicros of simulated time
+ *     (edges that arrive while an ISR runs are latched, so close edges can be coalesced or lost)
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <chrono>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "NewEncoderPort.h"
+#include "NewEncoderGroup.h"
+#include "NewEncoderT.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint8_t aPin = 2;
+constexpr uint8_t bPin = 3;
+constexpr int32_t cyclesPerRun = 200000;
+constexpr uint32_t isrMicros = 4;  // Simulated ISR duration, about that of NewEncoder's ISR on a 16 MHz AVR
+
+struct Scenario {
+	const char *name;
+	EncoderSimulator::Profile profile;
+};
+
+const Scenario scenarios[] = {
+		{ "clean", EncoderSimulator::clean },
+		{ "bouncy", EncoderSimulator::bouncy },
+		{ "very fast", EncoderSimulator::veryFast },
+};
+
+// Encoder configurations measured. setup() runs after begin() to enable optional features.
+struct Variant {
+	const char *name;
+	uint8_t type;
+	int32_t detentsPerCycle;  // 0 if the variant does not count one per detent
+	void (*setup)(NewEncoder &encoder);
+};
+
+#if NEWENCODER_EVENT_QUEUE
+NewEncoder::EventBuffer<64> eventBuffer;
+NewEncoder::EncoderEvent drainBuffer[64];
+
+void attachQueue(NewEncoder &encoder) {
+	encoder.attachEventQueue(&eventBuffer);
+}
+#endif
+
+#if NEWENCODER_TRACE
+NewEncoder::TraceBuffer<4096> traceBuffer;
+
+void attachTrace(NewEncoder &encoder) {
+	encoder.attachTrace(&traceBuffer);
+}
+#endif
+
+#if NEWENCODER_ACCELERATION
+void enableAcceleration(NewEncoder &encoder) {
+	encoder.setAcceleration(NewEncoder::defaultAccelerationCurve, NewEncoder::defaultAccelerationCurveSteps);
+}
+#endif
+
+#if NEWENCODER_RATE
+void enableRate(NewEncoder &encoder) {
+	encoder.setRateUnits(NewEncoder::EdgesPerSecond);
+}
+#endif
+
+void sampleBothPins(NewEncoder &encoder) {
+	encoder.end();
+	encoder.setBothPinSampling(true);  // Takes effect at begin()
+	encoder.begin();
+}
+
+const Variant variants[] = {
+		{ "FULL_PULSE", FULL_PULSE, 1, nullptr },
+		{ "HALF_PULSE", HALF_PULSE, 2, nullptr },
+		{ "QUAD_X4", QUAD_X4, 4, nullptr },
+		{ "QUAD_X2", QUAD_X2, 2, nullptr },
+#if NEWENCODER_EVENT_QUEUE
+		{ "FULL+queue", FULL_PULSE, 1, attachQueue },
+#endif
+#if NEWENCODER_TRACE
+		{ "FULL+trace", FULL_PULSE, 1, attachTrace },
+#endif
+#if NEWENCODER_ACCELERATION
+		{ "FULL+accel", FULL_PULSE, 0, enableAcceleration },
+#endif
+#if NEWENCODER_RATE
+		{ "FULL+rate", FULL_PULSE, 1, enableRate },
+#endif
+		{ "FULL+both", FULL_PULSE, 1, sampleBothPins },
+};
+
+struct RunResult {
+	double seconds;
+	uint64_t cycles;
+	uint64_t edges;
+	int32_t counted;
+};
+
+#if NEWENCODER_EVENT_QUEUE
+void drainEvents(NewEncoder *encoder) {
+	while (encoder->readEvents(drainBuffer, 64) != 0) {
+	}
+}
+#endif
+
+template<typename Encoder>
+void drainEvents(Encoder *encoder) {
+	(void) encoder;
+}
+
+// Rotate CW then CCW so the value stays inside the int16_t range without saturating
+template<typename Encoder>
+RunResult run(EncoderSimulator &sim, const EncoderSimulator::Profile &profile, Encoder *encoder) {
+	NewEncoder::EncoderState state;
+	int32_t counted = 0;
+	uint64_t startEdges = sim.edgeCount();
+	HostHal::isrMicros = isrMicros;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t startCycles = HostHal::cycleCount();
+	for (int32_t pass = 0; pass < cyclesPerRun / 1000; pass++) {
+		int32_t direction = (pass & 1) ? -1 : 1;
+		NewEncoder::EncoderValue before = 0;
+		if (encoder != nullptr) {
+			encoder->getState(state);
+			before = state.currentValue;
+		}
+		sim.rotate(direction * 1000, profile);
+		if (encoder != nullptr) {
+			encoder->getState(state);
+			counted += direction * (state.currentValue - before);
+			drainEvents(encoder);
+		}
+	}
+	uint64_t cycles = HostHal::cycleCount() - startCycles;
+	auto stop = std::chrono::steady_clock::now();
+	HostHal::isrMicros = 0;
+	return {std::chrono::duration<double>(stop - start).count(), cycles, sim.edgeCount() - startEdges, counted};
+}
+
+void report(const char *name, const char *profileName, const RunResult &result, const RunResult &baseline,
+		int32_t expected) {
+	double nsPerEdge = 1e9 * (result.seconds - baseline.seconds) / result.edges;
+	double cyclesPerEdge = static_cast<double>(result.cycles - baseline.cycles) / result.edges;
+	printf("%-12s  %-9s  %12.0f  %8.1f  %8.1f  ", name, profileName, result.edges / result.seconds, nsPerEdge,
+			cyclesPerEdge);
+	if (expected != 0) {
+		printf("%8ld\n", static_cast<long>(expected - result.counted));
+	} else {
+		printf("%8s\n", "-");
+	}
+}
+
+void benchmark(const Variant &variant) {
+	for (const Scenario &scenario : scenarios) {
+		HostHal::reset();
+		EncoderSimulator sim(aPin, bPin);
+		sim.reset();
+
+		// Simulator-only baseline, no encoder attached
+		RunResult baseline = run<NewEncoder>(sim, scenario.profile, nullptr);
+
+		NewEncoder encoder(aPin, bPin, -30000, 30000, 0, variant.type);
+		if (!encoder.begin()) {
+			printf("begin() failed\n");
+			return;
+		}
+		if (variant.setup != nullptr) {
+			variant.setup(encoder);
+		}
+		RunResult result = run(sim, scenario.profile, &encoder);
+		encoder.end();
+
+		report(variant.name, scenario.name, result, baseline, variant.detentsPerCycle * cyclesPerRun);
+	}
+}
+
+NewEncoderPort *benchmarkedPort;
+
+// Stands in for the port's pin-change interrupt, attached to the pins of the rotated encoder
+void portChangeIsr() {
+	benchmarkedPort->portChange();
+}
+
+// One port-change ISR decoding numEncoders encoders on host port 0. Encoder 0 is rotated; the others
+// are registered so the per-sample scan cost is included.
+void benchmarkPort(uint8_t numEncoders, const EncoderSimulator::Profile &profile, const char *profileName) {
+	HostHal::reset();
+	EncoderSimulator sim(0, 1);
+	sim.reset();
+	RunResult baseline = run<NewEncoder>(sim, profile, nullptr);
+
+	NewEncoder encoders[NEWENCODER_MAX_PORT_ENCODERS];
+	NewEncoderPort port;
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		encoders[i].configure(2 * i, 2 * i + 1, -30000, 30000, 0, FULL_PULSE);
+		port.add(encoders[i]);
+	}
+	if (!port.begin()) {
+		printf("port begin() failed\n");
+		return;
+	}
+	benchmarkedPort = &port;
+	attachInterrupt(0, portChangeIsr, CHANGE);
+	attachInterrupt(1, portChangeIsr, CHANGE);
+	RunResult result = run(sim, profile, &encoders[0]);
+	detachInterrupt(0);
+	detachInterrupt(1);
+	port.end();
+
+	char name[16];
+	snprintf(name, sizeof(name), "port x%u", numEncoders);
+	report(name, profileName, result, baseline, cyclesPerRun);
+}
+
+// Contact chatter: 25 bounce pairs, 1us apart, before every edge settles
+constexpr EncoderSimulator::Profile chatter { 1000, 25, 1 };
+
+#if NEWENCODER_GLITCH_FILTER
+// FULL_PULSE and QUAD_X4 with and without a 100us glitch filter, on bouncy and chattering edges
+void benchmarkFilter() {
+	const Scenario filterScenarios[] = { { "bouncy", EncoderSimulator::bouncy }, { "chatter", chatter } };
+	const Variant filterVariants[] = { { "FULL_PULSE", FULL_PULSE, 1, nullptr }, { "QUAD_X4", QUAD_X4, 4, nullptr } };
+	const uint32_t filterSettings[] = { 0, 100 };
+	for (const Variant &variant : filterVariants) {
+		for (uint32_t filterMicros : filterSettings) {
+			for (const Scenario &scenario : filterScenarios) {
+				HostHal::reset();
+				EncoderSimulator sim(aPin, bPin);
+				sim.reset();
+				RunResult baseline = run<NewEncoder>(sim, scenario.profile, nullptr);
+
+				NewEncoder encoder(aPin, bPin, -30000, 30000, 0, variant.type);
+				if (!encoder.begin()) {
+					printf("begin() failed\n");
+					return;
+				}
+				encoder.setGlitchFilter(filterMicros);
+				RunResult result = run(sim, scenario.profile, &encoder);
+				uint32_t filtered = encoder.getFilteredEdges();
+				encoder.end();
+
+				char name[16];
+				snprintf(name, sizeof(name), "%s%s", (variant.type == FULL_PULSE) ? "FULL" : "QUAD",
+						(filterMicros != 0) ? "+filter" : "");
+				report(name, scenario.name, result, baseline, variant.detentsPerCycle * cyclesPerRun);
+				if (filterMicros != 0) {
+					printf("%-12s  %-9s  %5.1f%% of edges filtered\n", "", "", 100.0 * filtered / result.edges);
+				}
+			}
+		}
+	}
+}
+#endif
+
+#if NEWENCODER_SHARED_INTERRUPTS
+// numEncoders encoders on the same pin pair, i.e. all linked into the same two interrupt chains. Encoder 0's
+// count is reported. Every other encoder must end up with the same value.
+void benchmarkShared(uint8_t numEncoders, const Scenario &scenario) {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	RunResult baseline = run<NewEncoder>(sim, scenario.profile, nullptr);
+
+	NewEncoder encoders[4];
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		encoders[i].configure(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+		if (!encoders[i].begin()) {
+			printf("begin() failed\n");
+			return;
+		}
+	}
+	RunResult result = run(sim, scenario.profile, &encoders[0]);
+
+	char name[16];
+	snprintf(name, sizeof(name), "shared x%u", numEncoders);
+	report(name, scenario.name, result, baseline, cyclesPerRun);
+
+	NewEncoder::EncoderState first, other;
+	encoders[0].getState(first);
+	for (uint8_t i = 1; i < numEncoders; i++) {
+		encoders[i].getState(other);
+		if (other.currentValue != first.currentValue) {
+			printf("shared encoder %u: value %ld, expected %ld\n", i, static_cast<long>(other.currentValue),
+					static_cast<long>(first.currentValue));
+		}
+	}
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		encoders[i].end();
+	}
+}
+#else
+// Without shared interrupts, an interrupt serves one encoder. A second encoder on the same pins, alone or in a group,
+// must fail to begin() and leave the first one counting.
+void checkExclusiveInterrupts() {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	NewEncoder first(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	NewEncoder second(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	NewEncoderGroup group;
+	group.add(first);
+	group.add(second);
+	bool ok = !group.begin() && first.begin() && !second.begin();
+	sim.rotate(5, EncoderSimulator::veryFast);
+	NewEncoder::EncoderState state;
+	first.getState(state);
+	ok = ok && (state.currentValue == 5);
+	first.end();
+	ok = ok && second.begin();
+	second.end();
+	if (!ok) {
+		printf("exclusive interrupts: check failed\n");
+	}
+}
+#endif
+
+// Compile-time specialized encoder on the same pins, saturating value policy
+void benchmarkTemplate(const Scenario &scenario) {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	RunResult baseline = run<NewEncoder>(sim, scenario.profile, nullptr);
+
+	NewEncoderT<aPin, bPin, FULL_PULSE> encoder(-30000, 30000, 0);
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return;
+	}
+	RunResult result = run(sim, scenario.profile, &encoder);
+	encoder.end();
+	report("NewEncoderT", scenario.name, result, baseline, cyclesPerRun);
+}
+
+#if NEWENCODER_ACCELERATION
+// A detent exactly one micros() wrap after a fast one must be a 1x step, even if getState() isn't called in between
+void checkAccelerationIdle() {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	NewEncoder encoder(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	enableAcceleration(encoder);
+	encoder.begin();
+	sim.rotate(3, EncoderSimulator::clean);
+	NewEncoder::EncoderState before;
+	encoder.getState(before);
+	HostHal::advanceMicros(0x80000000UL);
+	HostHal::advanceMicros(0x80000000UL);
+	sim.rotate(1, EncoderSimulator::clean);
+	NewEncoder::EncoderState after;
+	encoder.getState(after);
+	encoder.end();
+	if (after.currentValue != before.currentValue + 1) {
+		printf("acceleration idle: check failed\n");
+	}
+}
+#endif
+
+// NewEncoderT and NewEncoder on the same pins: whichever begins first keeps the interrupts until its end()
+void checkTemplateInterrupts() {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	NewEncoderT<aPin, bPin, FULL_PULSE> templateEncoder(-30000, 30000, 0);
+	NewEncoder encoder(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	bool ok = templateEncoder.begin() && !encoder.begin();
+	sim.rotate(5, EncoderSimulator::veryFast);
+	NewEncoder::EncoderState state;
+	templateEncoder.getState(state);
+	ok = ok && (state.currentValue == 5);
+	templateEncoder.end();
+	ok = ok && encoder.begin() && !templateEncoder.begin();
+	sim.rotate(3, EncoderSimulator::veryFast);
+	encoder.getState(state);
+	ok = ok && (state.currentValue == 3);
+	encoder.end();
+	ok = ok && templateEncoder.begin();
+	templateEncoder.end();
+	if (!ok) {
+		printf("template interrupts: check failed\n");
+	}
+}
+
+#if NEWENCODER_STATS
+void countDetent(NewEncoder *encoder, const volatile NewEncoder::EncoderState *state, void *userPointer) {
+	(void) encoder;
+	(void) state;
+	(*static_cast<uint32_t*>(userPointer))++;
+}
+
+void printHistogram(const char *name, const uint32_t *histogram) {
+	printf("  %-9s", name);
+	for (uint8_t bucket = 0; bucket < NEWENCODER_STATS_BUCKETS; bucket++) {
+		if (histogram[bucket] != 0) {
+			printf("  <%lu:%lu", 1UL << bucket, static_cast<unsigned long>(histogram[bucket]));
+		}
+	}
+	printf("\n");
+}
+
+// Counters and duration histograms (cycles, bucket "<n" = below n cycles) of one FULL_PULSE encoder with a callback
+void reportStats(const Scenario &scenario) {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	NewEncoder encoder(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	uint32_t callbacks = 0;
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return;
+	}
+	encoder.attachCallback(countDetent, &callbacks);
+	encoder.resetStats();
+	sim.rotate(1000, scenario.profile);
+	sim.rotate(-1000, scenario.profile);
+
+	NewEncoder::EncoderStats stats;
+	encoder.getStats(stats);
+	encoder.end();
+	printf("%-9s  edges %lu  no-op %lu  illegal %lu  detents %lu\n", scenario.name, static_cast<unsigned long>(stats.edges),
+			static_cast<unsigned long>(stats.noOpEdges), static_cast<unsigned long>(stats.illegalTransitions),
+			static_cast<unsigned long>(stats.detents));
+	printHistogram("ISR", stats.isrHistogram);
+	printHistogram("callback", stats.callbackHistogram);
+}
+#endif
+
+// 12 encoders read once per loop iteration while one of them turns: getState() on each vs one getStates()
+void benchmarkGroup() {
+	constexpr uint8_t numEncoders = 12;
+	constexpr uint32_t loops = 200000;
+	NewEncoder encoders[numEncoders];
+	NewEncoder::EncoderState states[numEncoders];
+	EncoderSimulator sim(2, 3);
+	const char *names[] = { "getState x12", "group x12" };
+
+	printf("\n%-12s  %12s  %10s  %10s\n", "read", "begin() ms", "ns/loop", "changed");
+	for (uint8_t grouped = 0; grouped < 2; grouped++) {
+		HostHal::reset();
+		sim.reset();
+		NewEncoderGroup group;
+		for (uint8_t i = 0; i < numEncoders; i++) {
+			encoders[i].configure(2 + 2 * i, 3 + 2 * i, -30000, 30000, 0, FULL_PULSE);
+			group.add(encoders[i]);
+		}
+		uint64_t startMicros = HostHal::simulatedMicros;
+		bool started = true;
+		if (grouped != 0) {
+			started = group.begin();
+		} else {
+			for (NewEncoder &encoder : encoders) {
+				started = encoder.begin() && started;
+			}
+		}
+		if (!started) {
+			printf("begin() failed\n");
+			return;
+		}
+		uint64_t beginMicros = HostHal::simulatedMicros - startMicros;
+
+		uint64_t changed = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t loop = 0; loop < loops; loop++) {
+			if ((loop & 0x0F) == 0) {
+				sim.rotate(((loop >> 4) & 1) ? -1 : 1, EncoderSimulator::veryFast);
+			}
+			if (grouped != 0) {
+				changed += __builtin_popcount(group.getStates(states));
+			} else {
+				for (uint8_t i = 0; i < numEncoders; i++) {
+					changed += encoders[i].getState(states[i]) ? 1 : 0;
+				}
+			}
+		}
+		auto stop = std::chrono::steady_clock::now();
+		for (NewEncoder &encoder : encoders) {
+			encoder.end();
+		}
+		printf("%-12s  %12.1f  %10.1f  %10llu\n", names[grouped], beginMicros / 1000.0,
+				1e9 * std::chrono::duration<double>(stop - start).count() / loops, static_cast<unsigned long long>(changed));
+	}
+}
+
+} // namespace
+
+int main() {
+	// Host sizes: pointers and registers are wider than on AVR, but the differences between builds carry over
+	constexpr size_t tableBytes = sizeof(NewEncoder::fullPulseTransitionTable) + sizeof(NewEncoder::halfPulseTransitionTable)
+			+ sizeof(NewEncoder::quadX4TransitionTable) + sizeof(NewEncoder::quadX2TransitionTable);
+	printf("NEWENCODER_COMPACT=%d  NEWENCODER_CLICK_FLAGS=%d  sizeof(NewEncoder) %u  transition tables %u bytes in %s\n\n",
+			NEWENCODER_COMPACT, NEWENCODER_CLICK_FLAGS, static_cast<unsigned>(sizeof(NewEncoder)),
+			static_cast<unsigned>(tableBytes), NEWENCODER_COMPACT ? "flash on AVR" : "RAM on AVR");
+	printf("lost: detents missed with each ISR taking %lu us of simulated time\n\n", static_cast<unsigned long>(isrMicros));
+	printf("%-12s  %-9s  %12s  %8s  %8s  %8s\n", "variant", "profile", "edges/s", "ns/edge", "cyc/edge", "lost");
+	for (const Variant &variant : variants) {
+		benchmark(variant);
+	}
+	for (const Scenario &scenario : scenarios) {
+		benchmarkTemplate(scenario);
+	}
+	checkTemplateInterrupts();
+#if NEWENCODER_ACCELERATION
+	checkAccelerationIdle();
+#endif
+#if NEWENCODER_GLITCH_FILTER
+	benchmarkFilter();
+#endif
+#if NEWENCODER_SHARED_INTERRUPTS
+	const uint8_t sharedSizes[] = { 2, 4 };
+	for (uint8_t numEncoders : sharedSizes) {
+		for (const Scenario &scenario : scenarios) {
+			benchmarkShared(numEncoders, scenario);
+		}
+	}
+#else
+	checkExclusiveInterrupts();
+#endif
+	const uint8_t portSizes[] = { 1, 4, 8, 16 };
+	for (uint8_t numEncoders : portSizes) {
+		for (const Scenario &scenario : scenarios) {
+			benchmarkPort(numEncoders, scenario.profile, scenario.name);
+		}
+	}
+	benchmarkGroup();
+#if NEWENCODER_STATS
+	printf("\n");
+	for (const Scenario &scenario : scenarios) {
+		reportStats(scenario);
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * EncoderSimulator.h - drives quadrature edge streams into the host HAL
+ *
+ * The simulated encoder walks the Gray-code sequence B/A = 11 -> 10 -> 00 -> 01 -> 11
+ * for clockwise rotation (reverse order for anti-clockwise). Every level change goes
+ * through HostHal::writePin(), so the encoder's attached interrupts fire exactly as
+ * they would on hardware.
+ */
+#ifndef NEWENCODER_HOST_ENCODERSIMULATOR_H_
+#define NEWENCODER_HOST_ENCODERSIMULATOR_H_
+
+#include "Arduino.h"
+
+class EncoderSimulator {
+public:
+	struct Profile {
+		uint32_t edgeMicros;      // Simulated time between quadrature edges
+		uint8_t bouncesPerEdge;   // Extra level toggles (pairs) before an edge settles
+		uint32_t bounceMicros;    // Simulated time between bounce toggles
+	};
+
+	static constexpr Profile clean { 500, 0, 0 };
+	static constexpr Profile bouncy { 500, 3, 5 };
+	static constexpr Profile veryFast { 2, 0, 0 };
+
+	EncoderSimulator(uint8_t aPin, uint8_t bPin) :
+			_aPin(aPin), _bPin(bPin) {
+	}
+
+	// Put the encoder at rest in a detent (both pins high) without generating interrupts
+	void reset(uint8_t position = 0) {
+		_position = position & 0b11;
+		HostHal::presetPin(_aPin, aLevel(_position));
+		HostHal::presetPin(_bPin, bLevel(_position));
+	}
+
+	// One quadrature edge in the given direction (+1 = CW, -1 = CCW)
+	void edge(int8_t direction, const Profile &profile) {
+		uint8_t newPosition = (_position + (direction > 0 ? 1 : 3)) & 0b11;
+		uint8_t pin = (aLevel(newPosition) != aLevel(_position)) ? _aPin : _bPin;
+		uint8_t level = (pin == _aPin) ? aLevel(newPosition) : bLevel(newPosition);
+
+		for (uint8_t bounce = 0; bounce < profile.bouncesPerEdge; bounce++) {
+			write(pin, level);
+			HostHal::advanceMicros(profile.bounceMicros);
+			write(pin, !level);
+			HostHal::advanceMicros(profile.bounceMicros);
+		}
+		write(pin, level);
+		HostHal::advanceMicros(profile.edgeMicros);
+		_position = newPosition;
+		_edges += 1 + 2 * profile.bouncesPerEdge;
+	}
+
+	// Rotate by a number of complete quadrature cycles (4 edges each)
+	void rotate(int32_t cycles, const Profile &profile) {
+		int8_t direction = (cycles >= 0) ? 1 : -1;
+		uint32_t edges = 4UL * static_cast<uint32_t>(cycles >= 0 ? cycles : -cycles);
+		for (uint32_t i = 0; i < edges; i++) {
+			edge(direction, profile);
+		}
+	}
+
+	// Total number of pin level changes generated so far
+	uint64_t edgeCount() const {
+		return _edges;
+	}
+
+private:
+	void write(uint8_t pin, uint8_t level) {
+		HostHal::writePin(pin, level);
+	}
+
+	// Position index 0..3 maps to B/A = 11, 10, 00, 01
+	static uint8_t aLevel(uint8_t position) {
+		return (position == 0) || (position == 3);
+	}
+
+	static uint8_t bLevel(uint8_t position) {
+		return position <= 1;
+	}
+
+	uint8_t _aPin, _bPin;
+	uint8_t _position = 0;
+	uint64_t _edges = 0;
+};
+
+#endif /* NEWENCODER_HOST_ENCODERSIMULATOR_H_ */
@@ -0,0 +1,242 @@
+/*
+ * PersistenceCheck.cpp - write coalescing, wear leveling, and power-loss recovery of NewEncoderStore
+ *
+ * Three encoders are turned in random bursts (1 to 30 detents at 50 detents/s, then 0.1 to 4 s
+ * still) for about an hour of simulated time, with update() called every millisecond as from
+ * loop(). The same session is run with several store settings on a 1 KB RamStorage and compared
+ * with writing each encoder's value to a fixed address whenever it changes. For each, reports the
+ * bytes written per detent (write amplification), the most writes to any one byte, and how many
+ * detents that byte would take to reach 100000 writes (a typical EEPROM endurance). After each
+ * session, a new store restored from the storage must return the encoders' final values.
+ *
+ * Then, for every point in a record at which power can be lost, and at several positions around
+ * the ring, checks that restore() returns the values of the last complete record. Also checks
+ * that members in the urgent mask are written at the next update().
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "NewEncoderStore.h"
+#include "EncoderSimulator.h"
+#include "RamStorage.h"
+
+namespace {
+
+constexpr uint8_t numEncoders = 3;
+constexpr uint8_t pins[numEncoders][2] = { { 2, 3 }, { 4, 5 }, { 6, 7 } };
+constexpr uint32_t numBursts = 1500;
+constexpr uint32_t storageBytes = 1024;
+constexpr uint32_t enduranceWrites = 100000;
+constexpr EncoderSimulator::Profile instant { 0, 0, 0 };
+
+NewEncoder::EncoderValue value(NewEncoder &encoder) {
+	NewEncoder::EncoderState state;
+	encoder.getState(state);
+	return state.currentValue;
+}
+
+struct Settings {
+	const char *name;
+	uint32_t idleMillis;
+	uint32_t maxDelayMillis;
+	uint16_t chunkBytes;
+};
+
+const Settings settings[] = {
+		{ "idle 250 ms", 250, 10000, 0 },
+		{ "idle 1 s", 1000, 10000, 0 },
+		{ "idle 1 s, 1 B/update", 1000, 10000, 1 },
+		{ "idle 5 s, max 10 s", 5000, 10000, 0 },
+};
+
+struct Rig {
+	EncoderSimulator sims[numEncoders] = { { pins[0][0], pins[0][1] }, { pins[1][0], pins[1][1] }, { pins[2][0], pins[2][1] } };
+	NewEncoder encoders[numEncoders];
+
+	bool begin(NewEncoderStore &store) {
+		for (uint8_t i = 0; i < numEncoders; i++) {
+			sims[i].reset();
+			encoders[i].configure(pins[i][0], pins[i][1], -1000, 1000, store.restoredValue(i, 0), FULL_PULSE);
+			if (!encoders[i].begin() || !store.add(encoders[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void detent(uint8_t index, int8_t direction) {
+		NewEncoder::EncoderValue current = value(encoders[index]);
+		if ((current >= 900) || (current <= -900)) {
+			direction = (current > 0) ? -1 : 1;  // Stay clear of the limits
+		}
+		sims[index].rotate(direction, instant);
+	}
+
+	void end() {
+		for (NewEncoder &encoder : encoders) {
+			encoder.end();
+		}
+	}
+};
+
+void printRow(const char *name, uint64_t records, uint64_t bytes, uint64_t detents, uint32_t maxWear) {
+	printf("%-22s  %8llu  %9llu  %8.3f  %8lu  %12.0f\n", name, static_cast<unsigned long long>(records),
+			static_cast<unsigned long long>(bytes), static_cast<double>(bytes) / detents, static_cast<unsigned long>(maxWear),
+			static_cast<double>(enduranceWrites) * detents / maxWear);
+}
+
+// Run the session with one set of store settings. Prints the write-per-change row first if asked.
+bool session(const Settings &config, bool printNaive) {
+	HostHal::reset();
+	RamStorage ram(storageBytes);
+	RamStorage naive(storageBytes);
+	NewEncoderStore store(ram, numEncoders);
+	store.setTiming(config.idleMillis, config.maxDelayMillis);
+	store.setChunkBytes(config.chunkBytes);
+	Rig rig;
+	if (store.restore() || !rig.begin(store)) {
+		printf("%s: restore() found a record in erased storage or begin() failed\n", config.name);
+		return false;
+	}
+
+	NewEncoder::EncoderValue naiveValues[numEncoders] = { 0, 0, 0 };
+	auto tick = [&](uint32_t ms) {
+		for (uint32_t i = 0; i < ms; i++) {
+			HostHal::advanceMicros(1000);
+			store.update();
+			for (uint8_t e = 0; e < numEncoders; e++) {
+				NewEncoder::EncoderValue current = value(rig.encoders[e]);
+				if (current != naiveValues[e]) {
+					naiveValues[e] = current;
+					naive.write(e * sizeof(current), reinterpret_cast<const uint8_t*>(&current), sizeof(current));
+				}
+			}
+		}
+	};
+
+	std::mt19937 rng(1);
+	uint64_t detents = 0;
+	for (uint32_t burst = 0; burst < numBursts; burst++) {
+		uint8_t index = rng() % numEncoders;
+		int8_t direction = (rng() & 1) ? 1 : -1;
+		uint32_t length = 1 + rng() % 30;
+		for (uint32_t d = 0; d < length; d++) {
+			rig.detent(index, direction);
+			tick(20);
+		}
+		detents += length;
+		tick(100 + rng() % 3900);
+	}
+
+	if (printNaive) {
+		printRow("write-per-change", naive.writeCalls(), naive.bytesWritten(), detents, naive.maxWear());
+	}
+	printRow(config.name, store.recordsWritten(), ram.bytesWritten(), detents, ram.maxWear());
+
+	store.flush();
+	NewEncoderStore check(ram, numEncoders);
+	bool ok = check.restore();
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		ok = ok && (check.restoredValue(i, 12345) == value(rig.encoders[i]));
+	}
+	if (!ok) {
+		printf("%s: restored values differ from the encoders'\n", config.name);
+	}
+	rig.end();
+	return ok;
+}
+
+// Lose power 'cut' bytes into a record written after 'records' complete ones
+bool powerCut(uint32_t records, uint16_t cut) {
+	HostHal::reset();
+	RamStorage ram(100);  // A few slots, so the ring wraps
+	NewEncoderStore store(ram, numEncoders);
+	store.restore();
+	Rig rig;
+	if (!rig.begin(store)) {
+		printf("begin() failed\n");
+		return false;
+	}
+	for (uint32_t r = 0; r < records; r++) {
+		rig.detent(r % numEncoders, 1);
+		store.flush();
+	}
+	NewEncoder::EncoderValue complete[numEncoders];
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		complete[i] = value(rig.encoders[i]);
+		rig.detent(i, -1);
+	}
+	ram.cutPowerAfter(cut);
+	store.flush();
+	ram.restorePower();
+
+	bool expectNew = (cut >= store.recordBytes());
+	NewEncoderStore after(ram, numEncoders);
+	bool ok = after.restore() || (records == 0 && !expectNew);
+	for (uint8_t i = 0; i < numEncoders; i++) {
+		NewEncoder::EncoderValue expected = expectNew ? value(rig.encoders[i]) : complete[i];
+		ok = ok && (after.restoredValue(i, complete[i]) == expected);
+	}
+	if (!ok) {
+		printf("power cut %u bytes into record %lu: wrong values restored\n", cut, static_cast<unsigned long>(records + 1));
+	}
+	rig.end();
+	return ok;
+}
+
+// An urgent member is written at the next update(), others wait for the idle time. Nothing is written if nothing changed.
+bool urgent() {
+	HostHal::reset();
+	RamStorage ram(storageBytes);
+	NewEncoderStore store(ram, numEncoders);
+	store.restore();
+	store.setUrgentMask(0b100);
+	Rig rig;
+	if (!rig.begin(store)) {
+		printf("begin() failed\n");
+		return false;
+	}
+	HostHal::advanceMicros(1000);
+	bool ok = !store.update() && (store.dirty() == 0);
+	rig.detent(0, 1);
+	HostHal::advanceMicros(1000);
+	ok = ok && !store.update() && (store.dirty() == 0b001);
+	rig.detent(2, 1);
+	HostHal::advanceMicros(1000);
+	ok = ok && store.update() && (store.dirty() == 0) && (store.recordsWritten() == 1);
+	store.flush();
+	ok = ok && (store.recordsWritten() == 1);
+	if (!ok) {
+		printf("urgent mask: unexpected records\n");
+	}
+	rig.end();
+	return ok;
+}
+
+} // namespace
+
+int main() {
+	bool ok = true;
+	printf("%-22s  %8s  %9s  %8s  %8s  %12s\n", "1 KB storage", "records", "bytes", "B/detent", "max wear", "detents/100k");
+	for (const Settings &config : settings) {
+		ok = session(config, &config == &settings[0]) && ok;
+	}
+
+	RamStorage sizingRam(100);
+	NewEncoderStore sizing(sizingRam, numEncoders);
+	uint32_t checks = 0;
+	for (uint32_t records = 0; records < 3 * sizing.slots(); records++) {
+		for (uint16_t cut = 0; cut <= sizing.recordBytes(); cut++) {
+			ok = powerCut(records, cut) && ok;
+			checks++;
+		}
+	}
+	printf("\npower cuts: %lu checked, %u-byte records in %lu slots\n", static_cast<unsigned long>(checks), sizing.recordBytes(),
+			static_cast<unsigned long>(sizing.slots()));
+	ok = urgent() && ok;
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/*
+ * PinSyncBenchmark.cpp - fastest lossless rotation with per-pin and both-pin sampling ISRs
+ *
+ * HostHal::maskedMicros masks interrupts for a while once every millisecond, as a long ISR or
+ * critical section does on a real MCU. If both pins change in that window, their ISRs run in
+ * priority order (A first), not in the order of the changes. A per-pin ISR (aPinChange() /
+ * bPinChange()) then applies its own pin's change against a stale level of the other pin, and the
+ * state machine loses the detent. With setBothPinSampling(true), each ISR reads both pins and
+ * applies both changes in rotation order.
+ *
+ * For each masked time, the quadrature edge spacing is reduced (with +/-25% jitter) until detents
+ * are lost. The fastest lossless speed is reported in detents/s for FULL_PULSE with each ISR type,
+ * with both pins on one port (one register load) and on two ports.
+ *
+ * Past those speeds, both pins may change between two samples (a missed edge). The second table
+ * runs 5000 cycles at 50 microseconds masked and reports how far the count drifts, how many of
+ * these two-pin jumps were replayed in the direction of recent motion (getInferredTransitions()),
+ * and how many had no known direction (getInvalidTransitions()). The QUAD modes always read both
+ * pins. The drift that remains comes from a pin changing twice while masked, which can't be seen.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr int32_t cyclesPerRun = 2000;
+constexpr uint32_t maskPeriodMicros = 1000;
+constexpr EncoderSimulator::Profile instant { 0, 0, 0 };
+
+struct Wiring {
+	const char *name;
+	uint8_t aPin;
+	uint8_t bPin;
+	bool bothPins;
+};
+
+const Wiring wirings[] = {
+		{ "per-pin", 2, 3, false },
+		{ "both-pin", 2, 3, true },
+		{ "both-pin, 2 ports", 2, 34, true },
+};
+
+// Detents lost in cyclesPerRun cycles CW then cyclesPerRun cycles CCW, edges spaced edgeMicros +/- 25%
+int32_t lostDetents(const Wiring &wiring, uint32_t maskedMicros, uint32_t edgeMicros) {
+	HostHal::reset();
+	EncoderSimulator sim(wiring.aPin, wiring.bPin);
+	sim.reset();
+	NewEncoder encoder;
+	encoder.configure(wiring.aPin, wiring.bPin, -30000, 30000, 0, FULL_PULSE);
+	encoder.setBothPinSampling(wiring.bothPins);
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return cyclesPerRun;
+	}
+	HostHal::maskedMicros = maskedMicros;
+	HostHal::maskPeriodMicros = maskPeriodMicros;
+
+	std::mt19937 rng(edgeMicros);
+	std::uniform_int_distribution<uint32_t> jitter(edgeMicros - edgeMicros / 4, edgeMicros + edgeMicros / 4);
+	NewEncoder::EncoderState state;
+	int32_t lost = 0;
+	for (int8_t direction = 1; direction >= -1; direction -= 2) {
+		encoder.getState(state);
+		NewEncoder::EncoderValue before = state.currentValue;
+		for (int32_t edge = 0; edge < 4 * cyclesPerRun; edge++) {
+			sim.edge(direction, instant);
+			HostHal::advanceMicros(jitter(rng));
+		}
+		HostHal::advanceMicros(maskPeriodMicros);  // Let the last ISRs run
+		encoder.getState(state);
+		lost += cyclesPerRun - direction * (state.currentValue - before);
+	}
+	encoder.end();
+	return lost;
+}
+
+// Smallest edge spacing (coarse steps, then 1 microsecond) with no lost detents
+uint32_t minEdgeMicros(const Wiring &wiring, uint32_t maskedMicros) {
+	uint32_t edgeMicros = 4 * maskedMicros;
+	while ((edgeMicros >= 16) && (lostDetents(wiring, maskedMicros, edgeMicros - edgeMicros / 8) == 0)) {
+		edgeMicros -= edgeMicros / 8;
+	}
+	while ((edgeMicros > 4) && (lostDetents(wiring, maskedMicros, edgeMicros - 1) == 0)) {
+		edgeMicros--;
+	}
+	return edgeMicros;
+}
+
+struct Degradation {
+	const char *name;
+	uint8_t type;
+	bool bothPins;
+	int32_t countsPerCycle;
+};
+
+const Degradation degradations[] = {
+		{ "FULL per-pin", FULL_PULSE, false, 1 },
+		{ "FULL both-pin", FULL_PULSE, true, 1 },
+		{ "QUAD_X4", QUAD_X4, false, 4 },
+		{ "QUAD_X2", QUAD_X2, false, 2 },
+};
+
+// Count drift and two-pin jumps for cyclesPerRun * 5 / 2 cycles CW at edgeMicros +/- 25%, 50 microseconds masked
+void degrade(const Degradation &config, uint32_t edgeMicros) {
+	constexpr int32_t cycles = cyclesPerRun * 5 / 2;
+	HostHal::reset();
+	EncoderSimulator sim(2, 3);
+	sim.reset();
+	NewEncoder encoder;
+	encoder.configure(2, 3, -30000, 30000, 0, config.type);
+	encoder.setBothPinSampling(config.bothPins);
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return;
+	}
+	HostHal::maskedMicros = 50;
+	HostHal::maskPeriodMicros = maskPeriodMicros;
+
+	std::mt19937 rng(edgeMicros);
+	std::uniform_int_distribution<uint32_t> jitter(edgeMicros - edgeMicros / 4, edgeMicros + edgeMicros / 4);
+	for (int32_t edge = 0; edge < 4 * cycles; edge++) {
+		sim.edge(1, instant);
+		HostHal::advanceMicros(jitter(rng));
+	}
+	HostHal::advanceMicros(maskPeriodMicros);
+	NewEncoder::EncoderState state;
+	encoder.getState(state);
+	printf("%-18s  %7lu us  %8ld  %8lu  %8lu\n", config.name, static_cast<unsigned long>(edgeMicros),
+			static_cast<long>(state.currentValue - cycles * config.countsPerCycle),
+			static_cast<unsigned long>(encoder.getInferredTransitions()), static_cast<unsigned long>(encoder.getInvalidTransitions()));
+	encoder.end();
+}
+
+} // namespace
+
+int main() {
+	const uint32_t maskedTimes[] = { 10, 20, 50, 100 };
+	printf("%-18s  %8s  %10s  %12s\n", "ISR", "masked", "edge us", "detents/s");
+	for (uint32_t maskedMicros : maskedTimes) {
+		for (const Wiring &wiring : wirings) {
+			uint32_t edgeMicros = minEdgeMicros(wiring, maskedMicros);
+			printf("%-18s  %6lu us  %10lu  %12.0f\n", wiring.name, static_cast<unsigned long>(maskedMicros),
+					static_cast<unsigned long>(edgeMicros), 1e6 / (4.0 * edgeMicros));
+		}
+	}
+	printf("\n%-18s  %10s  %8s  %8s  %8s\n", "50 us masked", "edge", "drift", "inferred", "invalid");
+	const uint32_t edgeTimes[] = { 40, 30, 20 };
+	for (const Degradation &config : degradations) {
+		for (uint32_t edgeMicros : edgeTimes) {
+			degrade(config, edgeMicros);
+		}
+	}
+	return 0;
+}
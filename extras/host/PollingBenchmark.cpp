@@ -0,0 +1,140 @@
+/*
+ * PollingBenchmark.cpp - maximum rotation speed of the polling backend at a given poll rate
+ *
+ * The encoder is wired to host pins 48 / 49, which have no interrupt, so begin() fails and
+ * beginPolling() is used. Simulated time is advanced from one due sample to the next with
+ * NewEncoder::pollAll(), the way a timer that is re-armed with pollAll()'s return value would.
+ *
+ *   - For each fixed poll interval, the quadrature edge spacing is reduced (with +/-25% jitter)
+ *     until detents are lost. The fastest lossless speed is reported in detents/s.
+ *   - The adaptive intervals are then compared with fixed fast polling: samples taken while the
+ *     knob is idle for one second, and detents lost when a turn starts from idle.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint8_t aPin = 48;
+constexpr uint8_t bPin = 49;
+constexpr int32_t cyclesPerRun = 2000;
+constexpr EncoderSimulator::Profile instant { 0, 0, 0 };
+
+uint64_t samples;
+
+// Advance simulated time by 'micros', calling pollAll() whenever a sample is due
+void runFor(uint32_t micros) {
+	uint64_t until = HostHal::simulatedMicros + micros;
+	for (;;) {
+		uint32_t due = NewEncoder::pollAll();
+		if (due == 0) {
+			continue;
+		}
+		if (HostHal::simulatedMicros + due > until) {
+			HostHal::advanceMicros(static_cast<uint32_t>(until - HostHal::simulatedMicros));
+			return;
+		}
+		HostHal::advanceMicros(due);
+		samples++;
+	}
+}
+
+// Detents lost in cyclesPerRun cycles CW then cyclesPerRun cycles CCW, edges spaced edgeMicros +/- 25%
+int32_t lostDetents(NewEncoder &encoder, EncoderSimulator &sim, uint32_t edgeMicros, std::mt19937 &rng) {
+	std::uniform_int_distribution<uint32_t> jitter(edgeMicros - edgeMicros / 4, edgeMicros + edgeMicros / 4);
+	NewEncoder::EncoderState state;
+	int32_t lost = 0;
+	for (int8_t direction = 1; direction >= -1; direction -= 2) {
+		encoder.getState(state);
+		NewEncoder::EncoderValue before = state.currentValue;
+		for (int32_t edge = 0; edge < 4 * cyclesPerRun; edge++) {
+			sim.edge(direction, instant);
+			runFor(jitter(rng));
+		}
+		encoder.getState(state);
+		lost += cyclesPerRun - direction * (state.currentValue - before);
+	}
+	return lost;
+}
+
+bool startEncoder(NewEncoder &encoder, EncoderSimulator &sim) {
+	HostHal::reset();
+	sim.reset();
+	encoder.configure(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	if (encoder.begin()) {
+		printf("begin() unexpectedly succeeded on non-interrupt pins\n");
+		encoder.end();
+	}
+	return encoder.beginPolling();
+}
+
+// Fastest lossless rotation at a fixed poll interval
+void maxSpeed(uint32_t pollMicros) {
+	NewEncoder encoder;
+	EncoderSimulator sim(aPin, bPin);
+	std::mt19937 rng(pollMicros);
+	uint32_t bestEdgeMicros = 0;
+	for (uint32_t edgeMicros = 4 * pollMicros; edgeMicros >= 4; edgeMicros -= (edgeMicros + 31) / 32) {
+		if (!startEncoder(encoder, sim)) {
+			printf("beginPolling() failed\n");
+			return;
+		}
+		encoder.setPollIntervals(pollMicros, pollMicros);
+		int32_t lost = lostDetents(encoder, sim, edgeMicros, rng);
+		encoder.end();
+		if (lost != 0) {
+			break;
+		}
+		bestEdgeMicros = edgeMicros;
+	}
+	printf("%8lu  %10.0f  %10lu  %12.0f\n", static_cast<unsigned long>(pollMicros), 1e6 / pollMicros,
+			static_cast<unsigned long>(bestEdgeMicros), 1e6 / (4.0 * bestEdgeMicros));
+}
+
+// Samples taken during one idle second, then detents lost by a 200 detent/s turn that starts from idle
+void adaptive(const char *name, uint32_t fastMicros, uint32_t slowMicros) {
+	NewEncoder encoder;
+	EncoderSimulator sim(aPin, bPin);
+	std::mt19937 rng(fastMicros + slowMicros);
+	if (!startEncoder(encoder, sim)) {
+		printf("beginPolling() failed\n");
+		return;
+	}
+	encoder.setPollIntervals(fastMicros, slowMicros);
+	runFor(1000000);
+	samples = 0;
+	runFor(1000000);
+	uint64_t idleSamples = samples;
+
+	std::uniform_int_distribution<uint32_t> jitter(1000, 1500);
+	NewEncoder::EncoderState state;
+	for (int32_t edge = 0; edge < 4 * 100; edge++) {
+		sim.edge(1, instant);
+		runFor(jitter(rng));
+	}
+	encoder.getState(state);
+	encoder.end();
+	printf("%-22s  %12llu  %10ld\n", name, static_cast<unsigned long long>(idleSamples),
+			static_cast<long>(100 - state.currentValue));
+}
+
+} // namespace
+
+int main() {
+	printf("%8s  %10s  %10s  %12s\n", "poll us", "samples/s", "edge us", "detents/s");
+	const uint32_t pollIntervals[] = { 50, 100, 250, 500, 1000 };
+	for (uint32_t pollMicros : pollIntervals) {
+		maxSpeed(pollMicros);
+	}
+
+	printf("\n%-22s  %12s  %10s\n", "intervals", "idle samples", "start lost");
+	adaptive("fixed 250us", 250, 250);
+	adaptive("adaptive 250us/2ms", 250, 2000);
+	adaptive("adaptive 250us/5ms", 250, 5000);
+	return 0;
+}
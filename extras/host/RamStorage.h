@@ -0,0 +1,96 @@
+/*
+ * RamStorage.h - RAM-backed NewEncoderStore::Storage for host checks
+ *
+ * Starts erased (all 0xFF) like a new EEPROM. Counts the bytes written and the writes to each
+ * byte (wear). cutPowerAfter(n) simulates losing power after n more bytes: later writes are
+ * dropped, leaving a torn record, until restorePower().
+ */
+#ifndef NEWENCODER_HOST_RAMSTORAGE_H_
+#define NEWENCODER_HOST_RAMSTORAGE_H_
+
+#include <algorithm>
+#include <vector>
+#include "NewEncoderStore.h"
+
+class RamStorage: public NewEncoderStore::Storage {
+public:
+	explicit RamStorage(uint32_t bytes) :
+			_memory(bytes, 0xFF), _wear(bytes, 0) {
+	}
+
+	uint32_t size() const override {
+		return static_cast<uint32_t>(_memory.size());
+	}
+
+	void read(uint32_t address, uint8_t *buffer, uint16_t length) override {
+		for (uint16_t i = 0; i < length; i++) {
+			buffer[i] = (address + i < _memory.size()) ? _memory[address + i] : 0xFF;
+		}
+	}
+
+	void write(uint32_t address, const uint8_t *data, uint16_t length) override {
+		_writeCalls++;
+		for (uint16_t i = 0; (i < length) && (address + i < _memory.size()); i++) {
+			if (_powerLeft == 0) {
+				return;
+			}
+			if (_powerLeft > 0) {
+				_powerLeft--;
+			}
+			_memory[address + i] = data[i];
+			_wear[address + i]++;
+			_bytesWritten++;
+		}
+	}
+
+	void commit() override {
+		_commits++;
+	}
+
+	// Drop all writes after the next 'bytes' bytes
+	void cutPowerAfter(uint32_t bytes) {
+		_powerLeft = bytes;
+	}
+
+	void restorePower() {
+		_powerLeft = -1;
+	}
+
+	uint64_t bytesWritten() const {
+		return _bytesWritten;
+	}
+
+	uint64_t writeCalls() const {
+		return _writeCalls;
+	}
+
+	uint64_t commits() const {
+		return _commits;
+	}
+
+	// Most writes to any one byte
+	uint32_t maxWear() const {
+		uint32_t most = 0;
+		for (uint32_t wear : _wear) {
+			most = (wear > most) ? wear : most;
+		}
+		return most;
+	}
+
+	void resetCounts() {
+		_bytesWritten = 0;
+		_writeCalls = 0;
+		_commits = 0;
+		std::fill(_wear.begin(), _wear.end(), 0);
+	}
+
+private:
+	std::vector<uint8_t> _memory;
+	std::vector<uint32_t> _wear;
+	int64_t _powerLeft = -1;  // -1 - no power cut pending
+	uint64_t _bytesWritten = 0;
+	uint64_t _writeCalls = 0;
+	uint64_t _commits = 0;
+};
+
+#endif /* NEWENCODER_HOST_RAMSTORAGE_H_ */
@@ -0,0 +1,186 @@
+/*
+ * StormFallback.cpp - interrupt-storm protection with fallback to polling
+ *
+ * Encoder A (pins 2, 3) has a line that fails: pin 2 chatters at random, 50 kHz on average, for
+ * 200 ms, then rests. Encoder B (pins 4, 5) is turned at 1000 detents/s the whole time. loop()
+ * calls serviceStorms() once every millisecond. With and without setStormProtection() on encoder A, reports:
+ *   - the pin 2 interrupts serviced, and the share of the CPU they would take at 5 microseconds each
+ *   - storms detected and the time encoder A spent polled
+ *   - detents lost by encoder B, and the drift of encoder A's value (a chattering pin alone can't
+ *     turn it)
+ * Checks that normal rotation at 1000 detents/s doesn't trip the limit, that the storm is
+ * detected with encoder B unaffected, that the interrupts are re-attached once the line has
+ * been quiet, and that encoder A then counts every detent again. Also checks that pollAll(),
+ * which may run in a timer interrupt, leaves an encoder in a storm alone, and that end() and
+ * begin() work during a storm and don't carry the edge count of the current window over.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint32_t stormMicros = 200000;
+constexpr uint32_t edgeMicros = 250;  // 1000 detents/s
+constexpr uint32_t isrMicros = 5;  // Assumed cost of one interrupt, for the CPU share
+constexpr uint16_t maxEdges = 100;  // Per 10 ms window. 1000 detents/s is 40.
+constexpr uint32_t quietMicros = 100000;
+constexpr EncoderSimulator::Profile instant { 0, 0, 0 };
+
+NewEncoder::EncoderValue value(NewEncoder &encoder) {
+	NewEncoder::EncoderState state;
+	encoder.getState(state);
+	return state.currentValue;
+}
+
+std::mt19937 rng;
+
+// Run 'micros' of simulated time in 10 microsecond steps: turn encoder B, chatter pin 2 if asked (a change in half of
+// the steps), and serviceStorms() every millisecond as loop() would
+void run(EncoderSimulator &simB, uint32_t micros, bool chatter, uint32_t &elapsed) {
+	for (uint32_t t = 0; t < micros; t += 10) {
+		if (chatter && ((rng() & 1) != 0)) {
+			HostHal::writePin(2, !HostHal::readPin(2));
+		}
+		if ((elapsed % edgeMicros) == 0) {
+			simB.edge(1, instant);
+		}
+		if ((elapsed % 1000) == 0) {
+			NewEncoder::serviceStorms();
+		}
+		HostHal::advanceMicros(10);
+		elapsed += 10;
+	}
+}
+
+bool storm(bool protect) {
+	HostHal::reset();
+	rng.seed(1);
+	EncoderSimulator simA(2, 3);
+	EncoderSimulator simB(4, 5);
+	simA.reset();
+	simB.reset();
+	NewEncoder encoderA(2, 3, -30000, 30000, 0, FULL_PULSE);
+	NewEncoder encoderB(4, 5, -30000, 30000, 0, FULL_PULSE);
+	if (protect) {
+		encoderA.setStormProtection(maxEdges, 10000, quietMicros);
+	}
+	if (!encoderA.begin() || !encoderB.begin()) {
+		printf("begin() failed\n");
+		return false;
+	}
+	bool ok = true;
+	uint32_t elapsed = 0;
+
+	// Normal rotation must not look like a storm
+	for (uint32_t detent = 0; detent < 100; detent++) {
+		for (uint8_t edge = 0; edge < 4; edge++) {
+			simA.edge(1, instant);
+			run(simB, edgeMicros, false, elapsed);
+		}
+	}
+	ok = ok && (encoderA.getStorms() == 0) && (value(encoderA) == 100);
+
+	uint32_t interruptsBefore = HostHal::interruptCounts[2];
+	NewEncoder::EncoderValue bBefore = value(encoderB);
+	run(simB, stormMicros, true, elapsed);
+	uint32_t stormInterrupts = HostHal::interruptCounts[2] - interruptsBefore;
+	bool polledInStorm = encoderA.stormActive() && (NewEncoder::pollAll() == 0xFFFFFFFFUL);
+	if (HostHal::readPin(2) == 0) {
+		HostHal::writePin(2, 1);  // Rest at the detent level
+	}
+	run(simB, quietMicros + 2000, false, elapsed);
+	int32_t bLost = static_cast<int32_t>(stormMicros + quietMicros + 2000) / (4 * edgeMicros) - (value(encoderB) - bBefore);
+
+	printf("%-10s  %10lu  %8.1f%%  %6lu  %9lu  %7ld  %6ld\n", protect ? "100/10 ms" : "off",
+			static_cast<unsigned long>(stormInterrupts), 100.0 * stormInterrupts * isrMicros / stormMicros,
+			static_cast<unsigned long>(encoderA.getStorms()), static_cast<unsigned long>(encoderA.getStormMillis()),
+			static_cast<long>(value(encoderA) - 100), static_cast<long>(bLost));
+
+	ok = ok && (value(encoderA) == 100) && (bLost == 0);
+	if (protect) {
+		ok = ok && polledInStorm && !encoderA.stormActive() && (encoderA.getStorms() == 1) && (stormInterrupts <= maxEdges + 1);
+	}
+
+	// Back on interrupts, every detent counts again
+	for (uint32_t detent = 0; detent < 50; detent++) {
+		for (uint8_t edge = 0; edge < 4; edge++) {
+			simA.edge(-1, instant);
+			run(simB, edgeMicros, false, elapsed);
+		}
+	}
+	ok = ok && (value(encoderA) == 50);
+	encoderA.end();
+	encoderB.end();
+	if (!ok) {
+		printf("protection %s: check failed\n", protect ? "on" : "off");
+	}
+	return ok;
+}
+
+// end() and begin() while polled because of a storm
+bool restartInStorm() {
+	HostHal::reset();
+	EncoderSimulator simA(2, 3);
+	EncoderSimulator simB(4, 5);
+	simA.reset();
+	simB.reset();
+	NewEncoder encoderA(2, 3, -30000, 30000, 0, FULL_PULSE);
+	encoderA.setStormProtection(maxEdges, 10000, quietMicros);
+	if (!encoderA.begin()) {
+		printf("begin() failed\n");
+		return false;
+	}
+	uint32_t elapsed = 0;
+	run(simB, 10000, true, elapsed);
+	bool ok = encoderA.stormActive();
+	if (HostHal::readPin(2) == 0) {
+		HostHal::writePin(2, 1);
+	}
+	encoderA.end();
+	ok = ok && !encoderA.stormActive() && (HostHal::isrTable[2] == nullptr) && (NewEncoder::serviceStorms() == 0xFFFFFFFFUL);
+	ok = ok && encoderA.begin();
+	simA.rotate(10, instant);
+	ok = ok && (value(encoderA) == 10) && (encoderA.getStorms() == 1);
+	encoderA.end();
+	if (!ok) {
+		printf("end() / begin() in a storm: check failed\n");
+	}
+	return ok;
+}
+
+// end() and begin() within one window: edges counted before end() must not add up to a storm after begin()
+bool restartInWindow() {
+	HostHal::reset();
+	EncoderSimulator simA(2, 3);
+	simA.reset();
+	NewEncoder encoderA(2, 3, -30000, 30000, 0, FULL_PULSE);
+	encoderA.setStormProtection(maxEdges, 10000, quietMicros);
+	bool ok = encoderA.begin();
+	simA.rotate(20, instant);  // 80 edges
+	encoderA.end();
+	ok = ok && encoderA.begin();
+	simA.rotate(10, instant);  // 40 more in the same window
+	ok = ok && !encoderA.stormActive() && (encoderA.getStorms() == 0) && (value(encoderA) == 30);
+	encoderA.end();
+	if (!ok) {
+		printf("end() / begin() in one window: check failed\n");
+	}
+	return ok;
+}
+
+} // namespace
+
+int main() {
+	printf("%-10s  %10s  %9s  %6s  %9s  %7s  %6s\n", "protection", "interrupts", "CPU", "storms", "polled ms", "A drift", "B lost");
+	bool ok = storm(false);
+	ok = storm(true) && ok;
+	ok = restartInStorm() && ok;
+	ok = restartInWindow() && ok;
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+/*
+ * TraceReplay.cpp - capture a pin trace, dump it, and replay it through other decoder configurations
+ *
+ * Capture: a FULL_PULSE encoder with a TraceBuffer attached is turned back and forth by the
+ * simulator, with clean, bouncy, and chattering edges plus short spikes on the idle pin. The ring is
+ * then written with TraceRing::dump() to an in-memory Print, exactly as a sketch would send it to Serial.
+ *
+ * Replay: the dump is parsed and its records are driven back into the fake pins with their recorded
+ * timing, so the real ISRs, filters, and transition tables decode them again. The same configuration
+ * as the capture must reproduce the captured value exactly. The other rows show how the count
+ * diverges between table types and glitch filter settings for the same physical edge stream.
+ *
+ * A dump saved from a real board can be replayed with: ./trace_replay dump.bin
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "TransitionTableBuilder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint8_t aPin = 2;
+constexpr uint8_t bPin = 3;
+constexpr uint32_t numBursts = 1000;  // Fits in the 32768 record ring
+constexpr EncoderSimulator::Profile chatter { 800, 8, 2 };
+
+class MemoryPrint: public Print {
+public:
+	size_t write(uint8_t value) override {
+		bytes.push_back(value);
+		return 1;
+	}
+	using Print::write;
+
+	std::vector<uint8_t> bytes;
+};
+
+struct Trace {
+	uint32_t ticksPerMicro;
+	uint32_t total;
+	std::vector<uint32_t> records;
+};
+
+uint32_t readWord(const std::vector<uint8_t> &bytes, size_t offset) {
+	return bytes[offset] | (bytes[offset + 1] << 8) | (bytes[offset + 2] << 16) | (static_cast<uint32_t>(bytes[offset + 3]) << 24);
+}
+
+bool parseDump(const std::vector<uint8_t> &bytes, Trace &trace) {
+	if ((bytes.size() < NewEncoder::TraceRing::DUMP_HEADER_BYTES) || (readWord(bytes, 0) != NewEncoder::TraceRing::DUMP_MAGIC)
+			|| (bytes[4] != NewEncoder::TraceRing::DUMP_VERSION)) {
+		printf("not a trace dump\n");
+		return false;
+	}
+	trace.ticksPerMicro = readWord(bytes, 8);
+	trace.total = readWord(bytes, 12);
+	uint32_t count = readWord(bytes, 16);
+	if ((trace.ticksPerMicro == 0) || (count == 0)
+			|| (bytes.size() != NewEncoder::TraceRing::DUMP_HEADER_BYTES + 4ULL * count)) {
+		printf("truncated trace dump\n");
+		return false;
+	}
+	trace.records.clear();
+	for (uint32_t i = 0; i < count; i++) {
+		trace.records.push_back(readWord(bytes, NewEncoder::TraceRing::DUMP_HEADER_BYTES + 4 * i));
+	}
+	return true;
+}
+
+// Turn the simulated encoder, return the net number of quadrature cycles
+int32_t capture(EncoderSimulator &sim) {
+	std::mt19937 rng(17);
+	int32_t cycles = 0;
+	for (uint32_t burst = 0; burst < numBursts; burst++) {
+		uint32_t r = rng();
+		int32_t burstCycles = static_cast<int32_t>(r % 7) - 3;
+		if ((cycles > 200) || (cycles < -200)) {
+			burstCycles = (cycles > 0) ? -3 : 3;  // Stay clear of the limits
+		}
+		const EncoderSimulator::Profile &profile = ((r & 0x700) == 0) ? chatter :
+				((r & 0x3000) == 0) ? EncoderSimulator::bouncy : EncoderSimulator::clean;
+		sim.rotate(burstCycles, profile);
+		cycles += burstCycles;
+		if ((r & 0x70000) == 0) {
+			// Spike on a pin that is not moving: too short to be a real edge
+			uint8_t pin = (r & 0x80000) ? aPin : bPin;
+			uint8_t level = HostHal::readPin(pin);
+			HostHal::writePin(pin, !level);
+			HostHal::advanceMicros(3);
+			HostHal::writePin(pin, level);
+		}
+		HostHal::advanceMicros(20000);
+	}
+	return cycles;
+}
+
+struct ReplayConfig {
+	const char *name;
+	uint8_t type;
+	const NewEncoder::encoderStateTransition (*table)[8];  // Used instead of type if not nullptr
+	uint32_t filterMicros;
+	int32_t countsPerCycle;
+};
+
+const ReplayConfig configs[] = {
+		{ "FULL_PULSE", FULL_PULSE, nullptr, 0, 1 },
+		{ "FULL_PULSE+filter", FULL_PULSE, nullptr, 100, 1 },
+		{ "FULL_PULSE+5ms", FULL_PULSE, nullptr, 5000, 1 },  // Longer than a burst of clean edges
+		{ "FullPulseTable", FULL_PULSE, &FullPulseTable::table, 0, 1 },
+		{ "HALF_PULSE", HALF_PULSE, nullptr, 0, 2 },
+		{ "HALF_PULSE+filter", HALF_PULSE, nullptr, 100, 2 },
+		{ "QUAD_X4", QUAD_X4, nullptr, 0, 4 },
+		{ "QUAD_X4+filter", QUAD_X4, nullptr, 100, 4 },
+		{ "QUAD_X2", QUAD_X2, nullptr, 0, 2 },
+};
+
+struct ReplayResult {
+	NewEncoder::EncoderValue value;
+	uint32_t invalid;
+	uint32_t filtered;
+};
+
+bool replay(const Trace &trace, const ReplayConfig &config, ReplayResult &result) {
+	HostHal::reset();
+	uint32_t levels = trace.records[0] & NewEncoder::TraceRing::LEVELS_MASK;  // Starting levels
+	HostHal::presetPin(aPin, levels & 0b01);
+	HostHal::presetPin(bPin, (levels >> 1) & 0b01);
+	NewEncoder encoder;
+	if (config.table != nullptr) {
+		encoder.configure(aPin, bPin, -30000, 30000, 0, *config.table);
+	} else {
+		encoder.configure(aPin, bPin, -30000, 30000, 0, config.type);
+	}
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return false;
+	}
+	encoder.setGlitchFilter(config.filterMicros);
+
+	// Convert the running tick count, not each interval, so rounding doesn't accumulate
+	uint64_t ticks = 0, micros = 0;
+	for (size_t i = 1; i < trace.records.size(); i++) {
+		uint32_t record = trace.records[i];
+		ticks += record >> NewEncoder::TraceRing::TIME_SHIFT;
+		uint64_t newMicros = ticks / trace.ticksPerMicro;
+		HostHal::advanceMicros(static_cast<uint32_t>(newMicros - micros));
+		micros = newMicros;
+		uint32_t newLevels = record & NewEncoder::TraceRing::LEVELS_MASK;
+		HostHal::writePin(aPin, newLevels & 0b01);  // If both changed, their order is unknown. A first.
+		HostHal::writePin(bPin, (newLevels >> 1) & 0b01);
+	}
+
+	NewEncoder::EncoderState state;
+	encoder.getState(state);
+	result = { state.currentValue, encoder.getInvalidTransitions(), encoder.getFilteredEdges() };
+	encoder.end();
+	return true;
+}
+
+void printHeader() {
+	printf("%-18s  %8s  %8s  %8s  %8s  %8s\n", "replayed as", "value", "expected", "diverge", "invalid", "filtered");
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	MemoryPrint dump;
+	int32_t cycles = 0;
+	NewEncoder::EncoderValue capturedValue = 0;
+	bool simulated = (argc < 2);
+
+	if (simulated) {
+		static NewEncoder::TraceBuffer<32768> traceBuffer;
+		HostHal::reset();
+		EncoderSimulator sim(aPin, bPin);
+		sim.reset();
+		NewEncoder encoder(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+		if (!encoder.begin()) {
+			printf("begin() failed\n");
+			return 1;
+		}
+		encoder.attachTrace(&traceBuffer);
+		cycles = capture(sim);
+		NewEncoder::EncoderState state;
+		encoder.getState(state);
+		capturedValue = state.currentValue;
+		encoder.end();
+		traceBuffer.dump(dump);
+		printf("captured %lu edges (%lu records, %lu bytes), %ld cycles turned, FULL_PULSE counted %ld\n",
+				static_cast<unsigned long>(sim.edgeCount()), static_cast<unsigned long>(traceBuffer.recorded()),
+				static_cast<unsigned long>(dump.bytes.size()), static_cast<long>(cycles), static_cast<long>(capturedValue));
+	} else {
+		FILE *file = fopen(argv[1], "rb");
+		if (file == nullptr) {
+			printf("can't open %s\n", argv[1]);
+			return 1;
+		}
+		int c;
+		while ((c = fgetc(file)) != EOF) {
+			dump.write(static_cast<uint8_t>(c));
+		}
+		fclose(file);
+	}
+
+	Trace trace;
+	if (!parseDump(dump.bytes, trace)) {
+		return 1;
+	}
+	if (trace.total != trace.records.size()) {
+		printf("%lu oldest records were overwritten, replay starts mid-stream\n",
+				static_cast<unsigned long>(trace.total - trace.records.size()));
+	}
+
+	bool passed = true;
+	printHeader();
+	for (const ReplayConfig &config : configs) {
+		ReplayResult result;
+		if (!replay(trace, config, result)) {
+			return 1;
+		}
+		int32_t expected = cycles * config.countsPerCycle;
+		if (simulated) {
+			printf("%-18s  %8ld  %8ld  %8ld  %8lu  %8lu\n", config.name, static_cast<long>(result.value),
+					static_cast<long>(expected), static_cast<long>(result.value - expected),
+					static_cast<unsigned long>(result.invalid), static_cast<unsigned long>(result.filtered));
+		} else {
+			printf("%-18s  %8ld  %8s  %8s  %8lu  %8lu\n", config.name, static_cast<long>(result.value), "-", "-",
+					static_cast<unsigned long>(result.invalid), static_cast<unsigned long>(result.filtered));
+		}
+		if (simulated && (&config == &configs[0]) && (result.value != capturedValue)) {
+			printf("replay of the capture configuration does not reproduce the captured value %ld -> FAIL\n",
+					static_cast<long>(capturedValue));
+			passed = false;
+		}
+	}
+	if (simulated && passed) {
+		printf("replay reproduces the captured value -> OK\n");
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/*
+ * TransitionTableCheck.cpp - run-time equivalence of TransitionTableBuilder tables and the built-in types
+ *
+ * The table checks themselves are static_asserts in TransitionTableBuilder.h, so this file only
+ * compiles if they pass. Here, each pair below is put on the same two pins (both encoders are linked
+ * into the same interrupts) and fed a long random stream of single edges with bounce and direction
+ * changes. The two values must agree after every edge:
+ *   - FullPulseTable    vs FULL_PULSE
+ *   - HalfPulseTable    vs HALF_PULSE (different state codes, same behavior)
+ *   - QuarterPulseTable vs QUAD_X4
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <random>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "TransitionTableBuilder.h"
+#include "EncoderSimulator.h"
+
+namespace {
+
+constexpr uint8_t aPin = 2;
+constexpr uint8_t bPin = 3;
+constexpr uint32_t edgesPerCheck = 2000000;
+
+bool checkPair(const char *name, const NewEncoder::encoderStateTransition (&table)[8], uint8_t type) {
+	HostHal::reset();
+	EncoderSimulator sim(aPin, bPin);
+	sim.reset();
+	NewEncoder built(aPin, bPin, -30000, 30000, 0, table);
+	NewEncoder builtIn(aPin, bPin, -30000, 30000, 0, type);
+	if (!built.begin() || !builtIn.begin()) {
+		printf("%s: begin() failed\n", name);
+		return false;
+	}
+
+	std::mt19937 rng(type);
+	NewEncoder::EncoderState builtState, builtInState;
+	int8_t direction = 1;
+	for (uint32_t edge = 0; edge < edgesPerCheck; edge++) {
+		uint32_t r = rng();
+		if ((r & 0x1F) == 0) {
+			direction = -direction;  // Turn back
+		}
+		EncoderSimulator::Profile profile = ((r & 0x300) == 0) ? EncoderSimulator::bouncy : EncoderSimulator::clean;
+		sim.edge(direction, profile);
+		built.getState(builtState);
+		builtIn.getState(builtInState);
+		if (builtState.currentValue != builtInState.currentValue) {
+			printf("%s: mismatch after %lu edges, %ld vs %ld\n", name, static_cast<unsigned long>(edge),
+					static_cast<long>(builtState.currentValue), static_cast<long>(builtInState.currentValue));
+			return false;
+		}
+		if ((builtState.currentValue > 20000) || (builtState.currentValue < -20000)) {
+			direction = (builtState.currentValue > 0) ? -1 : 1;  // Stay clear of the limits
+		}
+	}
+	built.end();
+	builtIn.end();
+	printf("%s: %lu edges, values agree -> OK\n", name, static_cast<unsigned long>(edgesPerCheck));
+	return true;
+}
+
+} // namespace
+
+int main() {
+	bool passed = checkPair("FullPulseTable", FullPulseTable::table, FULL_PULSE);
+	passed = checkPair("HalfPulseTable", HalfPulseTable::table, HALF_PULSE) && passed;
+	passed = checkPair("QuarterPulseTable", QuarterPulseTable::table, QUAD_X4) && passed;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+ * WaitForChange.cpp - blocking waitForChange() and coroutine nextEvent() on the host build
+ *
+ *   - Blocking: a producer thread plays the interrupt side and turns the encoder in bursts of fast
+ *     rotation. A consumer thread sleeps in waitForChange(). It must end with the encoder's value,
+ *     and the detents between two of its wakeups must be coalesced into one (fewer wakeups than
+ *     detents, no wakeup without a change). The number of state reads is compared with a consumer
+ *     that busy-polls getState() over the same bursts.
+ *   - Coroutine (C++20 builds): a coroutine loops on co_await encoder.nextEvent(). An event loop turns
+ *     the encoder and calls NewEncoder::service(). The coroutine must never run in (simulated)
+ *     interrupt context, must see the latest value after every service(), must be resumed at
+ *     most once per service(), and must release its deferred slot when it finishes.
+ *
+ * See README.md in this directory for build instructions.
+ */
+#include <atomic>
+#include <random>
+#include <thread>
+#include <stdio.h>
+#include "Arduino.h"
+#include "NewEncoder.h"
+#include "EncoderSimulator.h"
+
+#if !NEWENCODER_ATOMIC_STATE
+#error "Build with -DNEWENCODER_ATOMIC_STATE=1"
+#endif
+
+namespace {
+
+constexpr uint8_t aPin = 2;
+constexpr uint8_t bPin = 3;
+constexpr uint32_t numBursts = 20000;
+
+struct ConsumerResult {
+	uint64_t getStateCalls = 0;
+	uint64_t wakeups = 0;
+	uint64_t timeouts = 0;
+	NewEncoder::EncoderValue lastValue = 0;
+};
+
+// Producer: bursts of 1 to 4 cycles in alternating directions, with a short real-time pause between them
+uint32_t produce(EncoderSimulator &sim) {
+	std::mt19937 rng(19);
+	uint32_t detents = 0;
+	for (uint32_t burst = 0; burst < numBursts; burst++) {
+		int32_t cycles = 1 + rng() % 4;
+		sim.rotate((burst & 1) ? -cycles : cycles, EncoderSimulator::veryFast);
+		detents += cycles;
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+	}
+	return detents;
+}
+
+bool threadTest(bool blocking, ConsumerResult &result) {
+	NewEncoder encoder(aPin, bPin, -30000, 30000, 0, FULL_PULSE);
+	EncoderSimulator sim(aPin, bPin);
+	std::atomic<bool> done(false);
+	HostHal::reset();
+	sim.reset();
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return false;
+	}
+
+	std::thread consumer([&] {
+		NewEncoder::EncoderState state;
+		for (;;) {
+			bool finished = done.load();
+			bool changed;
+			if (blocking) {
+				changed = encoder.waitForChange(state, 20);
+			} else {
+				changed = encoder.getState(state);
+			}
+			result.getStateCalls++;
+			if (changed) {
+				result.wakeups++;
+				result.lastValue = state.currentValue;
+			} else if (finished) {
+				break;
+			} else {
+				result.timeouts++;
+			}
+		}
+	});
+	uint32_t detents = produce(sim);
+	done.store(true);
+	consumer.join();
+
+	NewEncoder::EncoderState state;
+	encoder.getState(state);
+	encoder.end();
+	bool passed = (result.lastValue == state.currentValue);
+	if (blocking) {
+		passed = passed && (result.wakeups < detents) && (result.getStateCalls == result.wakeups + result.timeouts + 1);
+	}
+	printf("%-9s  %8lu detents  %8lu changes seen  %10llu state reads -> %s\n", blocking ? "blocking" : "busy poll",
+			static_cast<unsigned long>(detents), static_cast<unsigned long>(result.wakeups),
+			static_cast<unsigned long long>(result.getStateCalls), passed ? "OK" : "FAIL");
+	return passed;
+}
+
+#if NEWENCODER_COROUTINES
+struct Task {
+	struct promise_type {
+		Task get_return_object() {
+			return {};
+		}
+		std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+		void return_void() {
+		}
+		void unhandled_exception() {
+		}
+	};
+};
+
+struct CoroutineRecord {
+	uint32_t resumes = 0;
+	uint32_t resumesInIsr = 0;
+	NewEncoder::EncoderValue lastValue = 0;
+	bool stop = false;
+};
+
+Task follow(NewEncoder &encoder, CoroutineRecord &record) {
+	while (!record.stop) {
+		NewEncoder::EncoderState state = co_await encoder.nextEvent();
+		record.resumes++;
+		if (HostHal::inIsr) {
+			record.resumesInIsr++;
+		}
+		record.lastValue = state.currentValue;
+	}
+}
+
+bool coroutineTest() {
+	NewEncoder encoder(aPin, bPin, -1000, 1000, 0, FULL_PULSE);
+	EncoderSimulator sim(aPin, bPin);
+	CoroutineRecord record;
+	std::mt19937 rng(20);
+	HostHal::reset();
+	sim.reset();
+	if (!encoder.begin()) {
+		printf("begin() failed\n");
+		return false;
+	}
+	follow(encoder, record);
+
+	bool passed = true;
+	int32_t value = 0;
+	uint32_t services = 0;
+	for (uint32_t burst = 0; burst < numBursts; burst++) {
+		int32_t cycles = static_cast<int32_t>(rng() % 7) - 3;
+		sim.rotate(cycles, EncoderSimulator::clean);
+		value += cycles;
+		uint32_t resumesBefore = record.resumes;
+		NewEncoder::service();
+		services++;
+		if ((record.resumes - resumesBefore > 1) || ((cycles != 0) && (record.lastValue != value))) {
+			passed = false;
+		}
+	}
+	record.stop = true;
+	sim.rotate(1, EncoderSimulator::clean);
+	NewEncoder::service();  // Let the coroutine finish
+	encoder.end();
+	passed = passed && (record.resumesInIsr == 0);
+
+	// The finished coroutine must have given its deferred slot back
+	NewEncoder others[NEWENCODER_MAX_DEFERRED];
+	for (NewEncoder &other : others) {
+		passed = passed && other.attachDeferredCallback([](NewEncoder*, const volatile NewEncoder::EncoderState*, void*) {
+		});
+	}
+	printf("coroutine  %8lu services  %8lu resumes  %8lu in ISR -> %s\n", static_cast<unsigned long>(services),
+			static_cast<unsigned long>(record.resumes), static_cast<unsigned long>(record.resumesInIsr), passed ? "OK" : "FAIL");
+	return passed;
+}
+#endif
+
+} // namespace
+
+int main() {
+	ConsumerResult busy, blocking;
+	bool passed = threadTest(false, busy);
+	passed = threadTest(true, blocking) && passed;
+#if NEWENCODER_COROUTINES
+	passed = coroutineTest() && passed;
+#else
+	printf("coroutine  not tested, build with -std=c++20\n");
+#endif
+	return passed ? 0 : 1;
+}
@@ -3,8 +3,12 @@
 // Teensy (and maybe others) define these automatically
 #if !defined(CORE_NUM_INTERRUPT)
 
+// Linux host build, see extras/host
+#if defined(NEWENCODER_HOST)
+  #define CORE_NUM_INTERRUPT	HOST_NUM_INTERRUPTS
+
 // Wiring boards
-#if defined(WIRING)
+#elif defined(WIRING)
   #define CORE_NUM_INTERRUPT	NUM_EXTERNAL_INTERRUPTS
 
 